@@ -3,6 +3,16 @@
 #include <string>
 #include <fstream>
 #include <iostream>
+#include <map>
+#include <chrono>
+#include <mutex>
+
+// Restarts in a row (subaddress 22 asking for a new cycle)
+// after which the blocking reads give up
+#define CITIROC_MAX_RESTARTS 100
+
+static std::mutex CITIROC_boardStatesMutex;
+static std::map<int, CITIROC_boardState> CITIROC_boardStates;
 
 int CITIROC_connect(char* CITIROC_serialNumber) {
     /**
@@ -12,19 +22,13 @@ int CITIROC_connect(char* CITIROC_serialNumber) {
      * @param CITIROC_usbID
      * @return true if CITIROC_usbID > 0
      */
-    printf("FTD2XX: Generating FTD2XX device list...\n");
-    int FT_numberOfDevices;
-    FT_STATUS status = FT_CreateDeviceInfoList(&FT_numberOfDevices);
-    if (status != FT_OK){return false;}
-    int numberOfUsbDevices = USB_GetNumberOfDevs();
-    printf("LALUSB: Trying to connect with the board...\n");
-    int usbID = OpenUsbDevice(CITIROC_serialNumber);
+    int usbID = CITIROC_usbOpen(CITIROC_serialNumber);
     return usbID;
 }
 
 bool CITIROC_initialize(const int CITIROC_usbId) {
     /**
-     * Looks for the right parameters at ODB and 
+     * Looks for the right parameters in the configuration snapshot and 
      * writes such parameters on the board registers. 
      * Run this before trying data acquisition.
      * @param  CITIROC_usbId: usb id for the board.
@@ -33,38 +37,35 @@ bool CITIROC_initialize(const int CITIROC_usbId) {
 
     // Variables from odb.
     bool usbStatus;
-    midas::odb daq_parameters(odbdir_DAQ);
-    midas::odb temp_parameters(odbdir_temp);
-    int txsize = (int)daq_parameters["FIFO write size"];
-    int rxsize = (int)daq_parameters["FIFO read size"];
-    int ttimeout = (int)daq_parameters["Write time out (1-255 ms)"];
-    int rtimeout = (int)daq_parameters["Read time out (1-255 ms)"];
+    std::shared_ptr<const CITIROC_config> config = CITIROC_getConfig();
+    int txsize = config->fifoWriteSize;
+    int rxsize = config->fifoReadSize;
+    int ttimeout = config->writeTimeout;
+    int rtimeout = config->readTimeout;
 
     printf("LALUSB: Initializing device of usb ID: %d...\n", CITIROC_usbId);
-    usbStatus = USB_Init(CITIROC_usbId, true);
-    if (usbStatus == false) { USB_Perror(USB_GetLastError()); return false; }
+    usbStatus = CITIROC_usbInit(CITIROC_usbId);
+    if (usbStatus == false) { CITIROC_usbPerror(); return false; }
 
     printf("LALUSB: Setting buffer sizes to (FIFO write size, FIFO read size): %i, %i\n", txsize, rxsize);
-    usbStatus = USB_SetXferSize(CITIROC_usbId, rxsize, txsize);
-    if (usbStatus == false) { USB_Perror(USB_GetLastError()); return false; }
+    usbStatus = CITIROC_usbSetXferSize(CITIROC_usbId, rxsize, txsize);
+    if (usbStatus == false) { CITIROC_usbPerror(); return false; }
 
     printf("LALUSB: Setting timeout values to (write timeout, read timeout): %i, %i\n", ttimeout, rtimeout);    
-    usbStatus = USB_SetTimeouts(CITIROC_usbId, ttimeout, rtimeout);
-    if (usbStatus == false) { USB_Perror(USB_GetLastError()); return false; }
+    usbStatus = CITIROC_usbSetTimeouts(CITIROC_usbId, ttimeout, rtimeout);
+    if (usbStatus == false) { CITIROC_usbPerror(); return false; }
     
     printf("CITIROC: Enabling CITIROC1A temperature sensors...\n");
-    usbStatus = CITIROC_sendWord(CITIROC_usbId, 63, "00110100");
-    CITIROC_readFPGASubAddress(CITIROC_usbId, 63);
-    if (usbStatus == false) { USB_Perror(USB_GetLastError()); return false; }
-
     printf("CITIROC: Setting temperature configurations...");
-    usbStatus = CITIROC_sendWord(CITIROC_usbId, 62, "00000011");
-    CITIROC_readFPGASubAddress(CITIROC_usbId, 62);
-    if (usbStatus == false) { USB_Perror(USB_GetLastError()); return false; }
-
-    usbStatus = CITIROC_sendWord(CITIROC_usbId, 62, "00000010");
+    CITIROC_batch batch;
+    CITIROC_batchClear(&batch, CITIROC_DEBUG_FLAG ? "temperature sensors" : NULL);
+    CITIROC_batchWrite(&batch, 63, 0x34); // 00110100
+    CITIROC_batchWrite(&batch, 62, 0x03); // 00000011
+    CITIROC_batchWrite(&batch, 62, 0x02); // 00000010
+    usbStatus = CITIROC_batchSubmit(CITIROC_usbId, &batch, &CITIROC_getBoardState(CITIROC_usbId).shadow);
+    CITIROC_readFPGASubAddress(CITIROC_usbId, 63);
     CITIROC_readFPGASubAddress(CITIROC_usbId, 62);
-    if (usbStatus == false) { USB_Perror(USB_GetLastError()); return false; }
+    if (usbStatus == false) { CITIROC_usbPerror(); return false; }
 
     printf("CITIROC: writing firmware options...");
     usbStatus = CITIROC_sendFirmwareSettings(CITIROC_usbId);
@@ -72,63 +73,151 @@ bool CITIROC_initialize(const int CITIROC_usbId) {
     return true;
 }
 
-bool CITIROC_sendFirmwareSettings(const int CITIROC_usbId) {
+bool CITIROC_getFirmwareWords(const CITIROC_config& config, byte* words) {
+    /**
+     * Build the firmware words from the Firmware parameters
+     * of a configuration snapshot.
+     * words[k] goes to subaddress CITIROC_firmwareSubAddresses[k],
+     * with the fields listed in CITIROC_firmwareFields.
+     * @param words: CITIROC_NB_FIRMWARE_WORDS bytes.
+     * @return true always.
+     */
+    for (int k=0; k<CITIROC_NB_FIRMWARE_WORDS; k++) {
+        words[k] = CITIROC_firmwareFixedBits[k];
+        for (int i=0; i<CITIROC_NB_FIRMWARE_FIELDS; i++) {
+            const CITIROC_registerField& field = CITIROC_firmwareFields[i];
+            if (field.subAddress != CITIROC_firmwareSubAddresses[k]) continue;
+            words[k] = CITIROC_fieldSet(words[k], field, config.firmware[i]);
+        }
+    }
+    return true;
+}
 
-    bool usbStatus;
+static bool CITIROC_writeFirmwareWords(const int CITIROC_usbId, const byte* words, const bool onlyChanged) {
+    /**
+     * Write the firmware words on subaddresses 0, 1, 2, 3 and 5.
+     * With onlyChanged, words already held by the shadow are not sent.
+     * @return true if all the writings are done correctly.
+     */
+    CITIROC_shadow& shadow = CITIROC_getBoardState(CITIROC_usbId).shadow;
+    CITIROC_batch batch;
+    CITIROC_batchClear(&batch, CITIROC_DEBUG_FLAG ? "firmware settings" : NULL);
+    for (int k=0; k<CITIROC_NB_FIRMWARE_WORDS; k++) {
+        byte current = 0;
+        if (onlyChanged && CITIROC_shadowGet(&shadow, CITIROC_firmwareSubAddresses[k], &current) && current == words[k]) continue;
+        CITIROC_batchWrite(&batch, CITIROC_firmwareSubAddresses[k], words[k]);
+    }
+    if (batch.ops.empty()) return true;
+    if (!CITIROC_batchSubmit(CITIROC_usbId, &batch, &shadow)) { CITIROC_usbPerror(); return false; }
 
-    midas::odb firmware(odbdir_firmware);
-    std::string disReadAdc         = (firmware["disReadAdc"] == true ) ? "1" : "0";
-    std::string enSerialLink       = (firmware["enSerialLink"] == true ) ? "1" : "0";
-    std::string selRazChn          = (firmware["selRazChn"] == true ) ? "1" : "0";    
-    std::string valEvt             = (firmware["valEvt"] == true ) ? "1" : "0";
-    std::string razChn             = (firmware["razChn"] == true ) ? "1" : "0";
-    std::string selValEvt          = (firmware["selValEvt"] == true ) ? "1" : "0";
-    std::string rstbPa             = (firmware["rstbPa"] == true) ? "1" : "0";
-    std::string select             = (firmware["select"] == true) ? "1" : "0";
-    std::string readOutSpeed       = (firmware["readOutSpeed"] == 1) ? "1" : "0";
-    std::string NOR32polarity      = (firmware["OR32polarity"] == true ) ? "1" : "0";
-    std::string ADC1               = (firmware["ADC1"] == true) ? "1" : "0";
-    std::string ADC2               = (firmware["ADC2"] == true) ? "1" : "0";
-    std::string rstbPS             = (firmware["rstbPS"] == true) ? "1" : "0";
-    std::string timeOutHold        = (firmware["timeOutHold"] == true) ? "1" : "0";
-    std::string selHold            = (firmware["selHold"] == true) ? "1" : "0";
-    std::string selTrigToHold      = (firmware["selTrigToHold"] == true) ? "1" : "0";
-    std::string triggerTorQ        = (firmware["triggerTorQ"] == true) ? "1" : "0";
-    std::string pwrOn              = (firmware["pwrOn"] == true) ? "1" : "0";
-    std::string selPSGlobalTrigger = (firmware["selPSGlobalTrigger"] == true) ? "1" : "0";
-    std::string selPSMode          = (firmware["selPSMode"] == true) ? "1" : "0"; 
-    std::string PSGlobalTrigger    = (firmware["PSGlobalTrigger"] == true) ? "1" : "0";
-    std::string PSMode             = (firmware["PSMode"] == true) ? "1" : "0";
-    
-    usbStatus = CITIROC_sendWord(CITIROC_usbId, 0, ("00"+disReadAdc+enSerialLink+selRazChn+valEvt+razChn+selValEvt).c_str());
-    if (usbStatus == false) { USB_Perror(USB_GetLastError()); return false; }
+    if (CITIROC_DEBUG_FLAG) {
+        printf("\n");
+        for (int k=0; k<CITIROC_NB_FIRMWARE_WORDS; k++) {
+            printf("To be written on %d: %u\n", CITIROC_firmwareSubAddresses[k], words[k]);
+            CITIROC_readFPGASubAddress(CITIROC_usbId, CITIROC_firmwareSubAddresses[k]);
+        }
+    }
+    return true;
+}
 
-    usbStatus = CITIROC_sendWord(CITIROC_usbId, 1, ("11"+select+rstbPa+readOutSpeed+NOR32polarity+"00").c_str());
-    if (usbStatus == false) { USB_Perror(USB_GetLastError()); return false; }
+bool CITIROC_sendFirmwareSettings(const int CITIROC_usbId) {
+    /**
+     * Write the firmware words from ODB on subaddresses 0, 1, 2, 3 and 5.
+     * @return true if all the writings are done correctly.
+     */
 
-    usbStatus = CITIROC_sendWord(CITIROC_usbId, 2, ("000001"+ADC1+ADC2).c_str());
-    if (usbStatus == false) { USB_Perror(USB_GetLastError()); return false; }
+    CITIROC_getBoardState(CITIROC_usbId).configured = false;
 
-    usbStatus = CITIROC_sendWord(CITIROC_usbId, 3, (rstbPS+"00"+timeOutHold+selHold+selTrigToHold+triggerTorQ+pwrOn).c_str());
-    if (usbStatus == false) { USB_Perror(USB_GetLastError()); return false; }
+    byte words[CITIROC_NB_FIRMWARE_WORDS];
+    CITIROC_getFirmwareWords(*CITIROC_getConfig(), words);
+    return CITIROC_writeFirmwareWords(CITIROC_usbId, words, false);
+}
 
-    usbStatus = CITIROC_sendWord(CITIROC_usbId, 5, ("0"+selPSGlobalTrigger+selPSMode+"000"+PSGlobalTrigger+PSMode).c_str());
-    if (usbStatus == false) { USB_Perror(USB_GetLastError()); return false; }
+static uint64_t CITIROC_fingerprint(const byte* asicWords, const int nbAsicWords,
+                                    const byte* firmwareWords, const int nbFirmwareWords) {
+    /**
+     * 64-bit FNV-1a hash of the packed ASIC image and the firmware words.
+     */
+    uint64_t hash = 14695981039346656037ULL;
+    for (int i=0; i<nbAsicWords; i++)     {hash ^= asicWords[i];     hash *= 1099511628211ULL;}
+    for (int i=0; i<nbFirmwareWords; i++) {hash ^= firmwareWords[i]; hash *= 1099511628211ULL;}
+    return hash;
+}
 
-    if (CITIROC_DEBUG_FLAG) {
-        std::cout << std::endl;
-        std::cout << "To be written on 0: " << ("00"+disReadAdc+enSerialLink+selRazChn+valEvt+razChn+selValEvt).c_str() << std::endl;
-        CITIROC_readFPGASubAddress(CITIROC_usbId, 0);
-        std::cout << "To be written on 1: " << ("111"+rstbPa+readOutSpeed+NOR32polarity+"00").c_str() << std::endl;    
-        CITIROC_readFPGASubAddress(CITIROC_usbId, 1);
-        std::cout << "To be written on 2: " << ("000001"+ADC1+ADC2).c_str() << std::endl;
-        CITIROC_readFPGASubAddress(CITIROC_usbId, 2);
-        std::cout << "To be written on 3: " << (rstbPS+"00"+timeOutHold+selHold+selTrigToHold+triggerTorQ+pwrOn).c_str() << std::endl; 
-        CITIROC_readFPGASubAddress(CITIROC_usbId, 3);
-        std::cout << "To be written on 5: " << ("0"+selPSGlobalTrigger+selPSMode+"000"+PSGlobalTrigger+PSMode).c_str() << std::endl;
-        CITIROC_readFPGASubAddress(CITIROC_usbId, 5);
+bool CITIROC_sendConfiguration(const int CITIROC_usbID) {
+    /**
+     * Send the ASIC and firmware settings from ODB,
+     * unless the board already confirmed the very same configuration
+     * (same fingerprint and correlation test passed at subaddress 4).
+     * A board holding a confirmed configuration only gets what changed:
+     * the ASIC image if it differs, and the firmware words
+     * that differ from the shadow.
+     * CITIROC_initialize and CITIROC_reset force a full upload.
+     * @return true if the board holds the ODB configuration.
+     */
+    CITIROC_boardState& state = CITIROC_getBoardState(CITIROC_usbID);
+    std::shared_ptr<const CITIROC_config> config = CITIROC_getConfig();
+
+    int nbChanged = CITIROC_asicUpdate(&state.asic, config->asic);
+    byte firmwareWords[CITIROC_NB_FIRMWARE_WORDS];
+    CITIROC_getFirmwareWords(*config, firmwareWords);
+    const uint64_t asicFingerprint = CITIROC_fingerprint(state.asic.packed, CITIROC_ASIC_BYTES, NULL, 0);
+    const uint64_t fingerprint = CITIROC_fingerprint(state.asic.packed, CITIROC_ASIC_BYTES,
+                                                     firmwareWords, CITIROC_NB_FIRMWARE_WORDS);
+
+    if (state.configured && fingerprint == state.fingerprint) {
+        if (CITIROC_DEBUG_FLAG) printf("CITIROC: Configuration unchanged (fingerprint %016llx), skipping upload.\n", (unsigned long long)fingerprint);
+        state.generation = config->generation;
+        return true;
+    }
+
+    const bool incremental = state.configured;
+    const bool sendImage   = !incremental || asicFingerprint != state.asicFingerprint;
+    printf("CITIROC: Uploading %s configuration (%d ASIC values re-encoded%s, fingerprint %016llx)\n",
+           incremental ? "changes to the" : "the", nbChanged, sendImage ? "" : ", image unchanged", (unsigned long long)fingerprint);
+    if (CITIROC_DEBUG_FLAG && sendImage) {CITIROC_asicPrint(&state.asic);}
+    state.configured = false;
+    bool asicStatus     = sendImage ? CITIROC_writeASIC(CITIROC_usbID, state.asic.packed, CITIROC_ASIC_BYTES) : true;
+    bool firmwareStatus = CITIROC_writeFirmwareWords(CITIROC_usbID, firmwareWords, incremental);
+    if (asicStatus && firmwareStatus) {
+        state.asicFingerprint = asicFingerprint;
+        state.fingerprint     = fingerprint;
+        state.generation      = config->generation;
+        state.configured      = true;
+    }
+    return asicStatus && firmwareStatus;
+}
+
+bool CITIROC_sendASICValue(const int CITIROC_usbID, const int field, const int index, const int value) {
+    /**
+     * Change one value of an ASIC field on the board, without ODB:
+     * only that value is re-encoded in the packed image before the upload,
+     * and the firmware words changed by the upload are written back.
+     * The next CITIROC_sendConfiguration restores the ODB value.
+     * @param field: index in CITIROC_asicFields.
+     * @param index: value of the field to change, -1 for all of them.
+     * @return true if the board confirmed the ASIC upload.
+     */
+    CITIROC_boardState& state = CITIROC_getBoardState(CITIROC_usbID);
+    std::vector<int> values = state.asic.values[field];
+    values.resize(CITIROC_asicFields[field].count, 0);
+    for (int i=0; i<(int)values.size(); i++) {
+        if (index < 0 || i == index) values[i] = value;
+    }
+    CITIROC_asicUpdateField(&state.asic, field, values);
+
+    state.configured = false;
+    byte firmwareWords[CITIROC_NB_FIRMWARE_WORDS];
+    CITIROC_getFirmwareWords(*CITIROC_getConfig(), firmwareWords);
+    bool asicStatus     = CITIROC_writeASIC(CITIROC_usbID, state.asic.packed, CITIROC_ASIC_BYTES);
+    bool firmwareStatus = CITIROC_writeFirmwareWords(CITIROC_usbID, firmwareWords, true);
+    if (asicStatus && firmwareStatus) {
+        state.asicFingerprint = CITIROC_fingerprint(state.asic.packed, CITIROC_ASIC_BYTES, NULL, 0);
+        state.fingerprint     = CITIROC_fingerprint(state.asic.packed, CITIROC_ASIC_BYTES,
+                                                    firmwareWords, CITIROC_NB_FIRMWARE_WORDS);
+        state.configured      = true;
     }
-     
+    return asicStatus && firmwareStatus;
 }
 
 bool CITIROC_reset(const int CITIROC_usbID){
@@ -139,7 +228,10 @@ bool CITIROC_reset(const int CITIROC_usbID){
      * @param CITIROC_usbID
      * @return true if CITIROC_usbID > 0
      */
-    USB_ResetDevice(CITIROC_usbID);
+    CITIROC_usbReset(CITIROC_usbID);
+    CITIROC_boardState& state = CITIROC_getBoardState(CITIROC_usbID);
+    state.configured = false;
+    CITIROC_shadowClear(&state.shadow);
     return true;
 }
 
@@ -149,133 +241,99 @@ bool CITIROC_disconnet(const int CITIROC_usbID) {
      * @param CITIROC_usbID
      * @return true always.
      */
-    CloseUsbDevice(CITIROC_usbID);
+    CITIROC_usbClose(CITIROC_usbID);
+    std::lock_guard<std::mutex> lock(CITIROC_boardStatesMutex);
+    CITIROC_boardStates.erase(CITIROC_usbID);
     return true;
 }
 
+CITIROC_boardState& CITIROC_getBoardState(const int CITIROC_usbID) {
+    /**
+     * State kept by the API for a board, created on first use.
+     * References stay valid until CITIROC_disconnet.
+     */
+    std::lock_guard<std::mutex> lock(CITIROC_boardStatesMutex);
+    return CITIROC_boardStates[CITIROC_usbID];
+}
+
+bool CITIROC_getGeometry(CITIROC_geometry* geometry) {
+    /**
+     * Read the acquisition geometry from the DAQ settings
+     * of the configuration snapshot.
+     * With "Max FIFO depth", each cycle arms as many acquisitions
+     * as subaddress 45 holds (255), to spread the arming overhead
+     * (subaddresses 45, 43, 22) over the largest cycle.
+     * Cycles never arm more acquisitions than the run asks for.
+     * @return false if a value was out of range and had to be clamped.
+     */
+    std::shared_ptr<const CITIROC_config> config = CITIROC_getConfig();
+    int  nbAcqInCycle = config->nbAcqInCycle;
+    int  nbAcq        = config->nbAcq;
+    int  nbChannels   = config->nbChannels;
+    bool maxDepth     = config->maxFIFODepth;
+    bool valid = true;
+
+    if (maxDepth) nbAcqInCycle = CITIROC_MAX_ACQ_IN_CYCLE;
+    if (nbAcqInCycle < 1)                        {nbAcqInCycle = 1; valid = false;}
+    if (nbAcqInCycle > CITIROC_MAX_ACQ_IN_CYCLE) {nbAcqInCycle = CITIROC_MAX_ACQ_IN_CYCLE; valid = false;}
+    if (nbAcq < 0)                               {nbAcq = 0; valid = false;}
+    if (nbAcq > 0 && nbAcqInCycle > nbAcq)       {nbAcqInCycle = nbAcq;}
+    if (nbChannels < 1)                          {nbChannels = 1; valid = false;}
+    if (nbChannels > CITIROC_NB_CHANNELS)        {nbChannels = CITIROC_NB_CHANNELS; valid = false;}
+
+    geometry->nbAcqInCycle = nbAcqInCycle;
+    geometry->nbAcq        = nbAcq;
+    geometry->nbChannels   = nbChannels;
+    printf("CITIROC: %d acquisitions per cycle, %d per run (0: no limit), %d channels\n", nbAcqInCycle, nbAcq, nbChannels);
+    return valid;
+}
+
 bool CITIROC_readFIFO_fixedAcqNumber(const int CITIROC_usbID, char* fifoHG, char* fifoLG) {
+    /**
+     * Read the number of acquisitions per run set at ODB,
+     * in cycles of the configured size; print the bytes read in debug mode.
+     * @return true if all the cycles were read, false on a short read
+     *         or after CITIROC_MAX_RESTARTS restarts in a row.
+     */
 
     CITIROC_sendFirmwareSettings(CITIROC_usbID);
 
-    int FIFOAcqLength = 100;
-    int nbAcq = 200;
-    int nbCycles = nbAcq / FIFOAcqLength;
-    if (nbAcq % FIFOAcqLength != 0 || nbCycles == 0) nbCycles++;
-    int NbChannels = 1;
+    CITIROC_geometry geometry;
+    CITIROC_getGeometry(&geometry);
+    int nbAcq = (geometry.nbAcq > 0) ? geometry.nbAcq : geometry.nbAcqInCycle;
 
-    int readBytes20 = 0, readBytes21 = 0, readBytes23 = 0, readBytes24 = 0;
+    // Sized once, for the largest cycle
+    CITIROC_rawCycle rawCycle;
+    for (int k=0; k<4; k++) rawCycle.fifo[k].resize(CITIROC_WORDS_PER_ACQ * geometry.nbAcqInCycle);
 
     printf("CITIROC: start DAQ\n");
-    for (int cycle=0; cycle<nbCycles; cycle++) {
-
-        int nbAcqInCycle = 0;
-        // HERE ADD OPTION FOR TIME ACQUISITION MODE
-        if (nbAcq >= FIFOAcqLength) nbAcqInCycle = FIFOAcqLength;
-        else if (nbAcq < FIFOAcqLength) nbAcqInCycle = nbAcq;
-
-        // Convert nbAcqInCycle -> strNbAcq (int -> std::string)
-        int bits[8];
-        std::string strNbAcq = "";
-        CITIROC_convertToBits(nbAcqInCycle, 8, bits);
-        printf("%i, ", nbAcqInCycle);
-        for (int j=0; j<8; j++) {printf("%i", bits[j]);}
-        printf(", ");
-        for (int bit: bits) {
-            strNbAcq.push_back(bit + '0');
+    int nbRestarts = 0;
+    while (nbAcq > 0) {
+        int nbAcqInCycle = (nbAcq >= geometry.nbAcqInCycle) ? geometry.nbAcqInCycle : nbAcq;
+        int nbData = CITIROC_WORDS_PER_ACQ * nbAcqInCycle;
+
+        int nbWords = CITIROC_readCycle(CITIROC_usbID, nbAcqInCycle, nbData, &rawCycle);
+        if (nbWords < 0) {
+            if (++nbRestarts < CITIROC_MAX_RESTARTS) continue;
+            printf("CITIROC: Subaddress 22 asked for a new cycle %d times in a row, giving up.\n", nbRestarts);
+            return false;
         }
-        printf("%s\n", strNbAcq.c_str());
-    
-        printf("\n");
-        CITIROC_sendWord(CITIROC_usbID, 45, strNbAcq.c_str());
-        CITIROC_sendWord(CITIROC_usbID, 43, "10000000");
-
-        std::string word4, word22;
-        CITIROC_readString(CITIROC_usbID, 4, &word4);
-        CITIROC_readString(CITIROC_usbID, 22, &word22);
-        std::cout << "word4: " << word4 << std::endl; 
-        std::cout << "word22: " << word22 << std::endl; 
-
-        if (word22.compare(std::string("00000000")) != 0) {cycle -= 1; continue; printf("cycle -1\n");}
-        
-        int nbData = (NbChannels + 1) * nbAcqInCycle;
-        char fifo20[nbData], fifo21[nbData], fifo23[nbData], fifo24[nbData];
-        int readBytes20 = UsbRd(CITIROC_usbID, 20, &fifo20, nbData);
-        int readBytes21 = UsbRd(CITIROC_usbID, 21, &fifo21, nbData);
-        int readBytes23 = UsbRd(CITIROC_usbID, 23, &fifo23, nbData);
-        int readBytes24 = UsbRd(CITIROC_usbID, 24, &fifo24, nbData);
-        printf("Read bytes (nbData): %d, %d, %d, %d (%d)\n", readBytes20, readBytes21, readBytes23, readBytes24, nbData);
-        
-        // TODO: Find if nbData and readBytes are the same.
-        // TODO: change nbData to readBytes20 below.
-        const int gainSize = 2*nbData;
-        unsigned char fifoHG[gainSize];
-        unsigned char fifoLG[gainSize];
-
-        for (int j=0; j < nbData; j++) {
-            fifoHG[j*2 + 1] = (unsigned char)fifo20[j];
-            fifoHG[j*2 + 0] = (unsigned char)fifo21[j];
-            fifoHG[j*2 + 1] = (unsigned char)fifo23[j];
-            fifoHG[j*2 + 0] = (unsigned char)fifo24[j];
+        nbRestarts = 0;
+        if (CITIROC_DEBUG_FLAG) {
+            printf("Read bytes (nbData): %d, %d, %d, %d (%d)\n", rawCycle.nbBytes[0], rawCycle.nbBytes[1], rawCycle.nbBytes[2], rawCycle.nbBytes[3], nbData);
         }
-
-        // long fifoHG_int[2*nbData],    fifoLG_int[2*nbData];
-        // char fifoHG_char[2*nbData],   fifoLG_char[2*nbData];
-        // int  fifoHG_bits[2*8*nbData], fifoLG_bits[2*8*nbData];
-        // convertFIFO(fifoHG, gainSize, &fifoHG_char, &fifoHG_bits);
-        // convertFIFO(fifoLG, 2*nbData, &fifoLG_char, &fifoLG_bits);
-
-        // printf("======== Cycle %d:\n", cycle);
-        // printf("fifoHG: ");
-        // for (int j=0; j < gainSize; j++) {
-        //         printf("%i, %u\n", j, fifoHG[j]);
-        //         printf(", %d", fifoHG[j]);
-        //         char final[1024];
-        //         int bits[8];
-        //         sprintf(final, "0x%x", (unsigned char)fifoHG[j]);
-        //         long ret = strtol(final, NULL, 16);
-        //         CITIROC_convertToBits(ret, 8, bits);
-        //         printf("%i, %d, %ld, ", j, fifoHG[j], ret);
-        //         for (int k=0; k < 8; k++) {
-        //             printf("%i", bits[k]);
-        //             fifoHG_bits[j*8+k] = bits[k];
-        //         }
-        //         printf("\n");
-        //     }
-
-        // int dataHG[NbChannels];
-        // for (int j=0; j<nbAcqInCycle; j++) {
-        //     for (int chn=0; chn<NbChannels+1; chn++) {
-        //         int boolArrayDataHG[] = {
-        //             fifoHG_bits[j*528 + chn*16+0],
-        //             fifoHG_bits[j*528 + chn*16+1],     
-        //             fifoHG_bits[j*528 + chn*16+2],     
-        //             fifoHG_bits[j*528 + chn*16+3],     
-        //             fifoHG_bits[j*528 + chn*16+4],     
-        //             fifoHG_bits[j*528 + chn*16+5],     
-        //             fifoHG_bits[j*528 + chn*16+6],     
-        //             fifoHG_bits[j*528 + chn*16+7],     
-        //             fifoHG_bits[j*528 + chn*16+8],     
-        //             fifoHG_bits[j*528 + chn*16+9],     
-        //             fifoHG_bits[j*528 + chn*16+10],     
-        //         };
-        //         dataHG[chn] = fifoHG_bits[0];
-        //     }
-        // }
-
-    CITIROC_sendWord(CITIROC_usbID, 43, "00000000");
+        if (nbWords < nbData) return false;
+        nbAcq -= nbAcqInCycle;
     }
 
-    return false;
+    return true;
 }
 
 bool CITIROC_sendWord(const int CITIROC_usbID, const char subAddress, const char* bitArray) {
     /* Converts char :word: to hexadecimal 
     then sends such value to :subAddress: on the FPGA. */
-    byte* binary = (byte*)bitArray;
-    long integer = strtol(binary, NULL, 2);
-    byte word[1] = {(byte)integer};
-    int realCount = UsbWrt(CITIROC_usbID, subAddress, word, 1);
-    if (realCount == 1) {return true;} else {return false;}
+    long integer = strtol(bitArray, NULL, 2);
+    return CITIROC_writeRegister(CITIROC_usbID, subAddress, (byte)integer);
 }
 
 bool CITIROC_sendWords(const int CITIROC_usbID, const char subAddress, char* asicString, const int wordCount) {
@@ -301,15 +359,15 @@ bool CITIROC_sendWords(const int CITIROC_usbID, const char subAddress, char* asi
         long reversedIntegerWord = strtol(reversedTemporaryWord, NULL, 2);
         asicWords[i] = (byte)reversedIntegerWord;
     }
-    writtenCount = UsbWrt(CITIROC_usbID, subAddress, asicWords, 143);
+    writtenCount = CITIROC_usbWrite(CITIROC_usbID, subAddress, asicWords, 143);
     printf("Byte count to ASIC: %d\n", writtenCount);
     return writtenCount;
 }
 
 bool CITIROC_readWord(const int CITIROC_usbID, const char subAddress, char* word, const int wordCount) {
-    /* Use UsbRd from LALUsb to read :word: from a given :subAddress:.
+    /* Use CITIROC_usbRead to read :word: from a given :subAddress:.
     :wordCount: must be equal to :realCount: */
-    int realCount = UsbRd(CITIROC_usbID, subAddress, word, wordCount);
+    int realCount = CITIROC_usbRead(CITIROC_usbID, subAddress, word, wordCount);
     if (realCount <= 0) {return false;} else {return true;}
 }
 
@@ -331,35 +389,88 @@ bool CITIROC_printWord(char subAddress, char* word, int wordCount){
 }
 
 bool CITIROC_readFPGASubAddress(const int usbId, const char subAddress) {
+    /**
+     * Print the byte at subAddress. Configuration registers
+     * written by this process are printed from the shadow, without USB.
+     */
     char array0;
-    bool readStatus   = CITIROC_readWord(usbId, subAddress, &array0, 1);
+    bool readStatus   = CITIROC_readRegister(usbId, subAddress, (byte*)&array0);
     bool printStatus  = CITIROC_printWord(subAddress, &array0, 1);
+    return readStatus && printStatus;
+}
+
+bool CITIROC_writeRegister(const int CITIROC_usbID, const char subAddress, const byte value) {
+    /**
+     * Write one byte on subAddress and keep it in the shadow.
+     * @return true if the byte was written.
+     */
+    byte word = value;
+    if (CITIROC_usbWrite(CITIROC_usbID, subAddress, &word, 1) != 1) return false;
+    CITIROC_shadowRecord(&CITIROC_getBoardState(CITIROC_usbID).shadow, subAddress, &word, 1);
+    return true;
+}
+
+bool CITIROC_readRegister(const int CITIROC_usbID, const char subAddress, byte* value) {
+    /**
+     * Read one byte from subAddress, from the shadow
+     * if it is a configuration register already written.
+     * @return true if the byte was read.
+     */
+    if (CITIROC_isConfigRegister(subAddress)
+        && CITIROC_shadowGet(&CITIROC_getBoardState(CITIROC_usbID).shadow, subAddress, value)) {
+        return true;
+    }
+    return CITIROC_usbRead(CITIROC_usbID, subAddress, value, 1) == 1;
+}
+
+int CITIROC_auditRegisters(const int CITIROC_usbID) {
+    /**
+     * Read back from the board every configuration register
+     * written by this process and compare it with the shadow.
+     * Do not call while the acquisition thread is using the board.
+     * @return number of registers that differ, -1 on USB error.
+     */
+    CITIROC_shadow& shadow = CITIROC_getBoardState(CITIROC_usbID).shadow;
+    byte expected[CITIROC_NB_SUBADDRESSES], actual[CITIROC_NB_SUBADDRESSES];
+    bool audited[CITIROC_NB_SUBADDRESSES] = {};
+
+    CITIROC_batch batch;
+    CITIROC_batchClear(&batch, CITIROC_DEBUG_FLAG ? "register audit" : NULL);
+    for (int sub=0; sub<CITIROC_NB_SUBADDRESSES; sub++) {
+        if (!CITIROC_isConfigRegister(sub) || !CITIROC_shadowGet(&shadow, sub, &expected[sub])) continue;
+        audited[sub] = true;
+        CITIROC_batchRead(&batch, sub, &actual[sub]);
+    }
+    // No shadow here: the bytes must come from the board.
+    if (!CITIROC_batchSubmit(CITIROC_usbID, &batch, NULL)) {CITIROC_usbPerror(); return -1;}
+
+    int nbDiffs = 0;
+    for (int sub=0; sub<CITIROC_NB_SUBADDRESSES; sub++) {
+        if (!audited[sub] || actual[sub] == expected[sub]) continue;
+        printf("CITIROC: Register %d is %u on the board, %u was written.\n", sub, actual[sub], expected[sub]);
+        nbDiffs++;
+    }
+    return nbDiffs;
 }
 
 bool CITIROC_readString(const int CITIROC_usbID, const char subAddress, std::string* wordString) {
     /*
      * Return by pointer a string with bits stored in :subAddress:.
      */
-    char array0; 
-    int realCount = UsbRd(CITIROC_usbID, subAddress, &array0, 1);
-    if (realCount <= 0) {return false;}
-    char final[1024];
-    int bits[8];
-    sprintf(final, "0x%x", (unsigned char)array0);
-    long ret = strtol(final, NULL, 16);
-    CITIROC_convertToBits(ret, 8, bits);
-    for (int bit: bits) {
-        wordString->push_back(bit + '0');
+    byte value;
+    if (!CITIROC_readRegister(CITIROC_usbID, subAddress, &value)) {return false;}
+    for (int j=7; j>=0; j--) {
+        wordString->push_back(((value >> j) & 1) + '0');
     }
     return true;
 }
 
 void CITIROC_raiseException() {
     /** 
-     *  Find the error raised by the LALUsb API.
+     *  Find the error raised by the USB transport.
      */
-    printf("LALUsb raised the following expection:\n");
-    USB_Perror(USB_GetLastError());
+    printf("%s raised the following expection:\n", CITIROC_getTransport()->name);
+    CITIROC_usbPerror();
 }
 
 bool CITIROC_convertToBits(int numberToConvert, const int numberOfBits, int* binary) {
@@ -383,463 +494,252 @@ bool CITIROC_convertToBits(int numberToConvert, const int numberOfBits, int* bin
 
 bool CITIROC_sendASIC(const int CITIROC_usbID) {
     /** 
-     * Create ASIC bit-stack and send to FPGA.
-     @param odbdir_asic_addresses: global odbxx object.
-     @param odbdir_asic_values: global odbxx object.
+     * Bring the packed ASIC image of the board up to date
+     * with the ODB parameters and send it to the FPGA.
+     * Only the values changed since the previous call are re-encoded,
+     * following the field map in CITIROC_asic.h.
+     @param odbdir_asic_values: ODB directory with the ASIC parameters.
      @return true if usbStatus successful.
      */
 
     printf("Preparing ASIC buffer...\n");
 
-    int bitCounter = 0;
-    std::array<int, 1144> asicStack;
-    std::vector<int> asicVector;
-
-    std::string bitStack;
-    midas::odb asic_subaddress(odbdir_asic_addresses);
-    midas::odb asic_values(odbdir_asic_values);
-    midas::odb asic_sizes(odbdir_asic_sizes);
-
-    std::vector<int> chn          = (std::vector<int>)asic_values["chn"];
-    std::vector<int> calibDacQ    = (std::vector<int>)asic_values["calibDacQ"];
-    std::vector<int> shapTimeLg   = (std::vector<int>)asic_values["shapingTimeLg"];
-    std::vector<int> shapTimeHg   = (std::vector<int>)asic_values["shapingTimeHg"];
-    std::vector<int> inputDAC     = (std::vector<int>)asic_values["inputDac"];
-    std::vector<int> cmdInputDAC  = (std::vector<int>)asic_values["sc_cmdInputDac"];
-    std::vector<int> highGain     = (std::vector<int>)asic_values["paHgGain"];
-    std::vector<int> lowGain      = (std::vector<int>)asic_values["paLgGain"];
-    std::vector<int> testHighGain = (std::vector<int>)asic_values["CtestHg"];
-    std::vector<int> testLowGain  = (std::vector<int>)asic_values["CtestLg"];
-    std::vector<int> enablePA     = (std::vector<int>)asic_values["enPa"];
-    
-    for (midas::odb& subkey : asic_values) {
-        std::vector<int> genericVector = (std::vector<int>)asic_values[subkey.get_name().c_str()];
-        for (int i=0; i < genericVector.size(); i++) {
-            int n = (int)genericVector.at(i);
-            const int numberOfBits = (int)asic_sizes[subkey.get_name().c_str()];
-            int binary[numberOfBits]; 
-            CITIROC_convertToBits(n, numberOfBits, binary);
-            for (int j=0; j<numberOfBits; j++) {asicVector.push_back(binary[j]);}
-        }
-    }
-
-    int bitCounterChn = 0;
-    int bitCalibDacQ  = 0; 
-    for (int i=0; i<chn.size(); i++) {
-        int binary4[4] = {0, 0, 0, 0};
-
-        CITIROC_convertToBits(chn.at(i), 4, binary4);
-        for (int j=0; j<4; j++) {asicStack[0+i*4+j]=binary4[3-j]; bitCounterChn++;}
-        for (int j=0; j<4; j++) {asicVector.at(0+i*4+j) = binary4[3-j];} 
+    CITIROC_boardState& state = CITIROC_getBoardState(CITIROC_usbID);
+    state.configured = false;
+    int nbChanged = CITIROC_asicUpdate(&state.asic, CITIROC_getConfig()->asic);
+    printf("ASIC: %d values re-encoded\n", nbChanged);
+    if (CITIROC_DEBUG_FLAG) {CITIROC_asicPrint(&state.asic);}
 
-        CITIROC_convertToBits(calibDacQ.at(i), 4, binary4);
-        for (int j=0; j<4; j++) {asicStack[128+i*4+j]=binary4[3-j]; bitCalibDacQ++;}
-        for (int j=0; j<4; j++) {asicVector.at(128+i*4+j) = binary4[3-j];} 
-
-    }
-    printf("Channel 0 to 31 4-bit_t: (should be 128): %d\n", bitCounterChn);
-    printf("Channel 0 to 31 4-bit:   (should be 128): %d\n", bitCalibDacQ);
-
-    int bitCounterLGshaper = 0;
-    int bitCounterHGshaper = 0;
-    for (int i=0; i<shapTimeLg.size(); i++) {
-        int binary3[3] = {0, 0, 0};
-
-        CITIROC_convertToBits(shapTimeLg.at(i), 3, binary3);
-        for (int j=0; j<3; j++) {asicStack[315+i*3+j]=binary3[2-j]; bitCounterLGshaper++;}
-        for (int j=0; j<3; j++) {asicVector.at(315+i*3+j) = binary3[2-j];} 
-
-        CITIROC_convertToBits(shapTimeHg.at(i), 3, binary3);
-        for (int j=0; j<3; j++) {asicStack[320+i*3+j]=binary3[2-j]; bitCounterHGshaper++;}
-        for (int j=0; j<3; j++) {asicVector.at(320+i*3+j) = binary3[2-j];} 
-
-    }
-    printf("Time constant LG shaper (should be 3): %d\n", bitCounterLGshaper);
-    printf("Time constant HG shaper (should be 3): %d\n", bitCounterHGshaper);
-
-    int bitCounterPA = 0;
-    for (int i=0; i < highGain.size(); i++) {
-        int binary6[6] = {0, 0, 0, 0, 0, 0};
-        
-        CITIROC_convertToBits(highGain.at(i), 6, binary6);
-        // for (int j=0; j<6; j++) {asicStack[619+i*15+j]=binary6[j]; bitCounterPA++;}
-        // for (int j=0; j<6; j++) {asicVector.at(619+i*15+j)=binary6[j];}
-        for (int j=0; j<6; j++) {asicStack[619+i*15+j]=binary6[5-j]; bitCounterPA++;}
-        for (int j=0; j<6; j++) {asicVector.at(619+i*15+j)=binary6[5-j];}
-
-        CITIROC_convertToBits(lowGain.at(i), 6, binary6);
-        // for (int j=0; j<6; j++) {asicStack[619+i*15+j]=binary6[j]; bitCounterPA++;}
-        // for (int j=0; j<6; j++) {asicVector.at(625+i*15+j) = binary6[j];}
-        for (int j=0; j<6; j++) {asicStack[625+i*15+j]=binary6[5-j]; bitCounterPA++;}
-        for (int j=0; j<6; j++) {asicVector.at(625+i*15+j) = binary6[5-j];}
-
-
-        asicStack[631+i*15] = testHighGain.at(i); bitCounterPA++;
-        asicVector.at(631+i*15) = testHighGain.at(i);
-
-        asicStack[632+i*15] = testLowGain.at(i); bitCounterPA++;
-        asicVector.at(632+i*15) = testLowGain.at(i);
-
-        asicStack[633+i*15] = enablePA.at(i); bitCounterPA++;
-        asicVector.at(633+i*15) = enablePA.at(i);
-
-    }
-    printf("Channel 0-31 PA bits (should be 480): %d\n", bitCounterPA );
-
-    int bitCounterDAC = 0;
-    for (int i=0; i < inputDAC.size(); i++) {
-        int binary8[8] = {0, 0, 0, 0, 0, 0, 0, 0};
-        CITIROC_convertToBits(inputDAC.at(i), 8, binary8);
-        
-        for (int j=0; j<8; j++) {asicStack[331+i*9+j]=binary8[j]; bitCounterDAC++;}
-        for (int j=0; j<8; j++) {asicVector.at(331+i*9+j) = binary8[j];}
-
-        asicStack[339+i*9] = cmdInputDAC.at(i); bitCounterDAC++;
-        asicVector.at(339+i*9) = cmdInputDAC.at(i);
-        }
-    printf("Input 8-bit DAC (should be 288): %d\n", bitCounterDAC );
-            
-    printf("ASIC stack: ");
-    for (int i=0; i < 1144; i++) {printf("%d", asicVector.at(i));}
-    printf("\nSize of stack: %d\n", asicVector.size() );
-
-    CITIROC_writeASIC(CITIROC_usbID, asicVector, asicVector.size()/8);
-
-    return true;
+    return CITIROC_writeASIC(CITIROC_usbID, state.asic.packed, CITIROC_ASIC_BYTES);
 }
 
-bool CITIROC_writeASIC(const int CITIROC_usbID, std::vector<int> asicVector, const int numberOfWords) {
+bool CITIROC_writeASIC(const int CITIROC_usbID, const byte* asicWords, const int numberOfWords) {
     /** 
-     *  Reverse asicVector. 
-     *  Split asicVector into an array of 8-character elements.
-     *  Send words to board.
+     *  Put the FPGA in ASIC-writing mode and send the packed ASIC words,
+     *  twice, for the slow-control correlation test.
      *  Please refer to "citiroc_fpga.xls" document.
-     @param asicVector: Contain vector with bits.
-     @param numberOfWords: Number of words inside asicVector.
+     @param asicWords: packed ASIC image, see CITIROC_asicImage.
+     @param numberOfWords: Number of words inside asicWords.
+     @return true if the correlation test passed.
      */
 
-    bool usbStatus;
-    int realCount = 0;
-    int reverseAsicString[1144];
-    byte asicWords[numberOfWords];
-    midas::odb firmware(odbdir_firmware);
-    std::vector<int> reverseAsicVector;
-    std::vector<const char*> words;
-
     printf("ASIC size: %d\n", numberOfWords);
-
-    for (int i=0; i<asicVector.size(); i++) {
-        reverseAsicString[i] = asicVector.at(asicVector.size()-1-i);
-        // reverseAsicString[i] = asicVector.at(i);
-    } 
-
-    for (int i=0; i<numberOfWords; i++) {
-        // char reversedTemporaryWord[9] = {NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL};
-        std::string reversedTemporaryWord="";
-        for (int j=0; j<8; j++) {reversedTemporaryWord+=std::to_string(reverseAsicString[8*i+7-j]);} // <<-USE THIS ONE
-        // for (int j=0; j<8; j++) {reversedTemporaryWord+=std::to_string(reverseAsicString[8*i+j]);}
-        byte* binary = (byte*)reversedTemporaryWord.c_str();
-        long reversedIntegerWord = strtol(binary, NULL, 2);
-        asicWords[i] = (byte)reversedIntegerWord;
-        if (CITIROC_DEBUG_FLAG) {
-            printf("asic[%d]: %u\n", i, asicWords[i]);
-        }
-        
+    if (CITIROC_DEBUG_FLAG) {
+        for (int i=0; i<numberOfWords; i++) {printf("asic[%d]: %u\n", i, asicWords[i]);}
     }
 
-    std::string rstbPa        = (firmware["rstbPa"] == true) ? "1" : "0";
-    std::string readOutSpeed  = (firmware["readOutSpeed"] == true) ? "1" : "0";
-    std::string NOR32polarity = (firmware["OR32polarity"] == true ) ? "1" : "0";
-    std::string disReadAdc    = (firmware["disReadAdc"] == true ) ? "1" : "0";
-    std::string enSerialLink  = (firmware["enSerialLink"] == true ) ? "1" : "0";
-    std::string selRazChn     = (firmware["selRazChn"] == true ) ? "1" : "0";
-    std::string valEvt        = (firmware["valEvt"] == true ) ? "1" : "0";
-    std::string razChn        = (firmware["razChn"] == true ) ? "1" : "0";
-    std::string selValEvt     = (firmware["selValEvt"] == true ) ? "1" : "0";
-
+    // Subaddress 1 with select = 1 (slow control) and shift bits 00,
+    // subaddress 0 with and without the checksum test query.
+    byte firmwareWords[CITIROC_NB_FIRMWARE_WORDS];
+    CITIROC_getFirmwareWords(*CITIROC_getConfig(), firmwareWords);
+    byte slowControl = CITIROC_fieldSet(firmwareWords[1], CITIROC_regSelect, 1);
+    slowControl = CITIROC_fieldSet(slowControl, CITIROC_regScShift, 0);
+    slowControl = CITIROC_fieldSet(slowControl, CITIROC_regScWrite, 0);
+    const byte shift     = CITIROC_fieldSet(slowControl, CITIROC_regScShift, 1);
+    const byte write     = CITIROC_fieldSet(slowControl, CITIROC_regScWrite, 1);
+    const byte testQuery = CITIROC_fieldSet(firmwareWords[0], CITIROC_regTestQuery, 1);
+    const byte noQuery   = CITIROC_fieldSet(firmwareWords[0], CITIROC_regTestQuery, 0);
+    byte word4 = 0;
+
+    CITIROC_batch batch;
+    CITIROC_batchClear(&batch, CITIROC_DEBUG_FLAG ? "ASIC upload" : NULL);
     // Select slow-control parameters on FPGA
-    usbStatus = CITIROC_sendWord(CITIROC_usbID, 1, ("111"+rstbPa+readOutSpeed+NOR32polarity+"00").c_str());
-    if (CITIROC_DEBUG_FLAG) {CITIROC_readFPGASubAddress(CITIROC_usbID, 1);}
-    if (usbStatus == false) {USB_Perror(USB_GetLastError()); return false;}
-
+    CITIROC_batchWrite(&batch, 1, slowControl);
     // Send ASIC bits to FPGA
-    realCount = UsbWrt(CITIROC_usbID, 10, asicWords, 143);
-    if (realCount != numberOfWords) {USB_Perror(USB_GetLastError()); return false;}
-
-    // Start shifting parameters
-    usbStatus = CITIROC_sendWord(CITIROC_usbID, 1, ("111"+rstbPa+readOutSpeed+NOR32polarity+"10").c_str());    
-    if (CITIROC_DEBUG_FLAG) {CITIROC_readFPGASubAddress(CITIROC_usbID, 1);}
-    if (usbStatus == false) {USB_Perror(USB_GetLastError()); return false;}
-
-    // Stop shifting parameters
-    usbStatus = CITIROC_sendWord(CITIROC_usbID, 1, ("111"+rstbPa+readOutSpeed+NOR32polarity+"00").c_str());
-    if (CITIROC_DEBUG_FLAG) {CITIROC_readFPGASubAddress(CITIROC_usbID, 1);}
-    if (usbStatus == false) {USB_Perror(USB_GetLastError()); return false;}
-
+    CITIROC_batchWriteBytes(&batch, 10, asicWords, numberOfWords);
+    // Start and stop shifting parameters
+    CITIROC_batchWrite(&batch, 1, shift);
+    CITIROC_batchWrite(&batch, 1, slowControl);
     // Slow control test checksum -> test query
-    usbStatus = CITIROC_sendWord(CITIROC_usbID, 0, ("10"+disReadAdc+enSerialLink+selRazChn+valEvt+razChn+selValEvt).c_str());
-    if (CITIROC_DEBUG_FLAG) {CITIROC_readFPGASubAddress(CITIROC_usbID, 1);}
-    if (usbStatus == false) {USB_Perror(USB_GetLastError()); return false;}
-
-    // Write 1 
-    usbStatus = CITIROC_sendWord(CITIROC_usbID, 1, ("111"+rstbPa+readOutSpeed+NOR32polarity+"01").c_str());    
-    if (CITIROC_DEBUG_FLAG) {CITIROC_readFPGASubAddress(CITIROC_usbID, 1);}
-    if (usbStatus == false) {USB_Perror(USB_GetLastError()); return false;}
-
-    // Write 1 again
-    usbStatus = CITIROC_sendWord(CITIROC_usbID, 1, ("111"+rstbPa+readOutSpeed+NOR32polarity+"00").c_str());
-    if (CITIROC_DEBUG_FLAG) {CITIROC_readFPGASubAddress(CITIROC_usbID, 1);}
-    if (usbStatus == false) {USB_Perror(USB_GetLastError()); return false;}
-
-    // Send-slow control parameters to FPGA
-    realCount = UsbWrt(CITIROC_usbID, 10, asicWords, 143);
-    if (realCount != numberOfWords) {USB_Perror(USB_GetLastError()); return false;}
-
-    // Start shifting parameters
-    usbStatus = CITIROC_sendWord(CITIROC_usbID, 1, ("111"+rstbPa+readOutSpeed+NOR32polarity+"10").c_str());    
-    if (CITIROC_DEBUG_FLAG) {CITIROC_readFPGASubAddress(CITIROC_usbID, 1);}
-    if (usbStatus == false) {USB_Perror(USB_GetLastError()); return false;}
+    CITIROC_batchWrite(&batch, 0, testQuery);
+    // Write 1, then write 1 again
+    CITIROC_batchWrite(&batch, 1, write);
+    CITIROC_batchWrite(&batch, 1, slowControl);
+    // Send slow-control parameters to FPGA again
+    CITIROC_batchWriteBytes(&batch, 10, asicWords, numberOfWords);
+    // Start and stop shifting parameters
+    CITIROC_batchWrite(&batch, 1, shift);
+    CITIROC_batchWrite(&batch, 1, slowControl);
+    // Correlation test result: bit 7 of subaddress 4 is set
+    // if the second upload shifted out the same bits as the first one.
+    CITIROC_batchRead(&batch, 4, &word4);
+    // Reset slow-control checksum test query
+    CITIROC_batchWrite(&batch, 0, noQuery);
 
-    // Stop shifting parameters
-    usbStatus = CITIROC_sendWord(CITIROC_usbID, 1, ("111"+rstbPa+readOutSpeed+NOR32polarity+"00").c_str());
+    if (!CITIROC_batchSubmit(CITIROC_usbID, &batch, &CITIROC_getBoardState(CITIROC_usbID).shadow)) {CITIROC_usbPerror(); return false;}
     if (CITIROC_DEBUG_FLAG) {CITIROC_readFPGASubAddress(CITIROC_usbID, 1);}
-    if (usbStatus == false) {USB_Perror(USB_GetLastError()); return false;}
 
-    // Correlation test result
-    std::string word4;
-    usbStatus = CITIROC_readString(CITIROC_usbID, 4, &word4);
-    if (word4.compare(std::string("10000000")) == 0) {
-        printf("ASIC: The checksum test results 1. Please check ASIC consistency and try again.\n");
-        return true;
+    const bool correlation = CITIROC_fieldGet(word4, CITIROC_regScCorrelation) == 1;
+    if (!correlation) {
+        printf("ASIC: The checksum test results 0. Please check ASIC consistency and try again.\n");
     }
-
-    // Reset slow-control checksum test query
-    usbStatus = CITIROC_sendWord(CITIROC_usbID, 0, ("00"+disReadAdc+enSerialLink+selRazChn+valEvt+razChn+selValEvt).c_str());
-
-    usbStatus = CITIROC_sendFirmwareSettings(CITIROC_usbID);
-
-    return false;
-
+    return correlation;
 }
 
 int CITIROC_readFIFO(const int CITIROC_usbID, int* dataLG, int* dataHG, int* totalHits, int run_number) {
 // int CITIROC_readFIFO(const int CITIROC_usbID, char* fifoHG, char* fifoLG) {
+    /**
+     * Read and decode the acquisitions of a run (one cycle in time mode),
+     * adding up the hits of each channel.
+     * @return bytes read from subaddress 20 in the last cycle,
+     *         -1 after CITIROC_MAX_RESTARTS restarts in a row.
+     */
 
-    midas::odb firmware(odbdir_firmware);
-    bool timeAcquisitionMode = firmware["timeAcquisitionMode"];
-
-    int FIFOAcqLength = 100;
-    int nbAcq = 200;
-    int nbCycles = nbAcq / FIFOAcqLength;
-    if (nbAcq % FIFOAcqLength != 0 || nbCycles == 0) nbCycles++;
-    int NbChannels = 1;
-    if (timeAcquisitionMode) nbCycles = 1;
-
-    int readBytes20 = 0, readBytes21 = 0, readBytes23 = 0, readBytes24 = 0;
+    bool timeAcquisitionMode = CITIROC_getConfig()->timeAcquisitionMode;
 
-    int Hit[NbChannels+1];
+    CITIROC_geometry geometry;
+    CITIROC_getGeometry(&geometry);
+    int nbAcq = (geometry.nbAcq > 0) ? geometry.nbAcq : geometry.nbAcqInCycle;
+    if (timeAcquisitionMode) nbAcq = geometry.nbAcqInCycle;
 
-    std::ofstream outputFile;
-    char fileName[1024];
-    sprintf(fileName, "~/online/test_run-%i.txt", run_number);
-    outputFile.open (fileName);
+    // Buffers sized once, for the largest cycle
+    int readBytes20 = 0;
+    CITIROC_rawCycle  rawCycle;
+    CITIROC_cycleData decoded;
+    for (int k=0; k<4; k++) rawCycle.fifo[k].resize(CITIROC_WORDS_PER_ACQ * geometry.nbAcqInCycle);
+    CITIROC_reserveCycle(&decoded, geometry.nbAcqInCycle);
 
     printf("CITIROC: start DAQ\n");
-    for (int cycle=0; cycle<nbCycles; cycle++) {
+    int nbRestarts = 0;
+    while (nbAcq > 0) {
+
+        int nbAcqInCycle = (nbAcq >= geometry.nbAcqInCycle) ? geometry.nbAcqInCycle : nbAcq;
+        int nbData = CITIROC_WORDS_PER_ACQ * nbAcqInCycle;
+        int nbWords = CITIROC_readCycle(CITIROC_usbID, nbAcqInCycle, nbData, &rawCycle);
+        if (nbWords < 0) {
+            if (++nbRestarts < CITIROC_MAX_RESTARTS) continue;
+            printf("CITIROC: Subaddress 22 asked for a new cycle %d times in a row, giving up.\n", nbRestarts);
+            return -1;
+        }
+        nbRestarts = 0;
+        nbAcq -= nbAcqInCycle;
+        readBytes20 = rawCycle.nbBytes[0];
+        if (CITIROC_DEBUG_FLAG) {
+            printf("Read bytes (nbData): %d, %d, %d, %d (%d)\n", rawCycle.nbBytes[0], rawCycle.nbBytes[1], rawCycle.nbBytes[2], rawCycle.nbBytes[3], nbData);
+        }
 
-        int nbAcqInCycle = 0;
-        
-        if (nbAcq >= FIFOAcqLength) nbAcqInCycle = FIFOAcqLength;
-        else if (nbAcq < FIFOAcqLength) nbAcqInCycle = nbAcq;
+        // FIFO HG: fifo21+fifo20, FIFO LG: fifo24+fifo23.
+        // See CITIROC_decoder.h for the bit layout of each 16-bit word.
+        CITIROC_decodeCycle(rawCycle.fifo[0].data(), rawCycle.fifo[1].data(),
+                            rawCycle.fifo[2].data(), rawCycle.fifo[3].data(),
+                            nbWords / CITIROC_WORDS_PER_ACQ, &decoded);
 
-        if (timeAcquisitionMode) nbAcqInCycle = FIFOAcqLength; 
+        for (int i=0; i<decoded.nbAcq; i++) {
+            for (int chn=0; chn<geometry.nbChannels; chn++) {
+                // 32 channels + 1 temperature sensor = 33 words per acquisition
+                const int j = i*CITIROC_WORDS_PER_ACQ + chn;
 
-        // Convert nbAcqInCycle -> strNbAcq (int -> std::string)
-        int bits[8];
-        std::string strNbAcq = "";
-        CITIROC_convertToBits(nbAcqInCycle, 8, bits);
-        printf("%i, ", nbAcqInCycle);
-        for (int j=0; j<8; j++) {printf("%i", bits[j]);}
-        printf(", ");
-        for (int bit: bits) {
-            strNbAcq.push_back(bit + '0');
-        }
-        printf("%s\n", strNbAcq.c_str());
-    
-        printf("\n");
-        CITIROC_sendWord(CITIROC_usbID, 45, strNbAcq.c_str());
-        CITIROC_sendWord(CITIROC_usbID, 43, "10000000");
-
-        std::string word4, word22;
-        CITIROC_readString(CITIROC_usbID, 4, &word4);
-        CITIROC_readString(CITIROC_usbID, 22, &word22);
-        std::cout << "word4: " << word4 << std::endl; 
-        std::cout << "word22: " << word22 << std::endl; 
-
-        if (word22.compare(std::string("00000000")) != 0) {cycle -= 1; continue; printf("cycle -1\n");}
-        
-        int nbData = (NbChannels + 1) * nbAcqInCycle;
-        char fifo20[nbData], fifo21[nbData], fifo23[nbData], fifo24[nbData];
-        readBytes20 = UsbRd(CITIROC_usbID, 20, &fifo20, nbData);
-        readBytes21 = UsbRd(CITIROC_usbID, 21, &fifo21, nbData);
-        readBytes23 = UsbRd(CITIROC_usbID, 23, &fifo23, nbData);
-        readBytes24 = UsbRd(CITIROC_usbID, 24, &fifo24, nbData);
-        printf("Read bytes (nbData): %d, %d, %d, %d (%d)\n", readBytes20, readBytes21, readBytes23, readBytes24, nbData);
-        
-        // TODO: Find if nbData and readBytes are the same.
-        // TODO: change nbData to readBytes20 below.
-        const int gainSize = 2*nbData;
-        unsigned char fifoHG[gainSize];
-        unsigned char fifoLG[gainSize];
-
-        // fifoHG[1] = fifo20[0]
-        // fifoHG[0] = fifo21[0]
-
-        // fifoLG[1] = fifo23[0]
-        // fifoLG[0] = fifo24[0]
-
-        // FIFO HG: fifo21+fifo20
-        // FIFO HG: ADC Readout HG[1...8] + ADC Readout [9..16] + ADC OTR HG + Hit + 0 + Start ADC Read out
-
-        for (int j=0; j<nbData; j++) {
-            fifoHG[j*2 + 1] = (unsigned char)fifo20[j];
-            fifoHG[j*2 + 0] = (unsigned char)fifo21[j];
-            fifoLG[j*2 + 1] = (unsigned char)fifo23[j];
-            fifoLG[j*2 + 0] = (unsigned char)fifo24[j];
+                dataHG[chn] = decoded.hg[j];
+                dataLG[chn] = decoded.lg[j];
+                totalHits[chn] += decoded.hit[j];
+            } 
         }
 
-        // Convert each fifoHG element to 8-bit words, following big endian format. CAREFUL -> LSB on the left now.
-        int fifoHGbits[8*nbData];
-        for (int j=0; j < nbData; j++) {
-            char tempWord[1024];
-            int  tempBits[8];
-            sprintf(tempWord, "0x%x", (unsigned char)fifoHG[j]);
-            long tempInt = strtol(tempWord, NULL, 16);
-            CITIROC_convertToBits(tempInt, 8, tempBits);
-            for (int k=0; k<8; k++) {
-                // TODO: tempBits[7-k]
-                fifoHGbits[j*8+k] = tempBits[k];
-            }
-        }
+    }
 
-        // Convert each fifoLG element to 8-bit words, following big endian format. CAREFUL -> LSB on the left now.
-        int fifoLGbits[8*nbData];
-        for (int j=0; j < nbData; j++) {
-            char tempWord[1024];
-            int  tempBits[8];
-            sprintf(tempWord, "0x%x", (unsigned char)fifoLG[j]);
-            long tempInt = strtol(tempWord, NULL, 16);
-            CITIROC_convertToBits(tempInt, 8, tempBits);
-            for (int k=0; k<8; k++) {
-                // TODO: try tempBits[7-k] later
-                fifoLGbits[j*8+k] = tempBits[k];
-            }
-        }
+    return readBytes20;
+}
 
-        // int dataHG[nbData];
-        // int dataLG[nbData];
-        int hit[nbData];
-        // int totalHit[nbData];
-
-        // HG 16 bits:
-        // FIFO20[0]:    StartADC ReadOut 
-        // FIFO20[1]:    0 
-        // FIFO20[2]:    Hit 
-        // FIFO20[3]:    ADC OTR HG
-        // FIFO20[4..7]: HG ADC[12..9]
-        // FIFO21[1..8]: HG ADC[8..1]
-
-        // LG 16 bits:
-        // FIFO23[0]:    0 
-        // FIFO23[1]:    0 
-        // FIFO23[2]:    0 
-        // FIFO23[3]:    ADC OTR LG
-        // FIFO23[4..7]: LG ADC[12..9]
-        // FIFO24[1..8]: LG ADC[8..1]
-    
-        for (int i=0; i<nbAcqInCycle; i++) {
-            std::string line;
-            for (int chn=0; chn<NbChannels+1; chn++) {
-                // 32 channels + 1 temperature sensor = 33 things to read out
-                // 33*16 = 528
-
-                // TODO: change int array to char
-                // TODO: use strncat to write on char
-                char adcHG[12];
-                for (int j=0; j<12; j++) {
-                    char tempOneBit[1] = {NULL};
-                    sprintf(tempOneBit,"%i",fifoHGbits[528*i+chn*16+j]);
-                    strncat(adcHG, &tempOneBit[0], 1);
-                }
-                dataHG[chn] = strtol(adcHG, NULL, 16);
-
-                char adcLG[12];
-                for (int j=0; j<12; j++) {
-                    char tempOneBit[1] = {NULL};
-                    sprintf(tempOneBit,"%i",fifoLGbits[528*i+chn*16+j]);
-                    strncat(adcLG, &tempOneBit[0], 1);
-                }
-                dataLG[chn] = strtol(adcLG, NULL, 16);
-
-                hit[chn] = fifoHGbits[i*528+chn*16+13];
-                totalHits[chn] += hit[chn];
-
-                if (chn==0) {line = std::to_string(chn);}
-                else {line = line+", "+std::to_string(chn);}
+int CITIROC_readCycle(const int CITIROC_usbID, const int nbAcqInCycle, const int nbData, CITIROC_rawCycle* cycle) {
+    /**
+     * Arm the board for nbAcqInCycle acquisitions (subaddresses 45, 43),
+     * read nbData bytes from each FIFO (subaddresses 20, 21, 23, 24)
+     * and disarm. The FIFO buffers of cycle only grow, so they are
+     * allocated once when the same cycle is reused.
+     * @param nbAcqInCycle: acquisitions per cycle, 1 to 255.
+     * @param nbData: bytes to read from each FIFO.
+     * @param cycle: raw bytes, byte counts and timestamps of the cycle.
+     * @return number of complete words read, 0 on timeout or if arming failed,
+     *         -1 if subaddress 22 asks for a new cycle.
+     */
+    const int armed = CITIROC_armCycle(CITIROC_usbID, nbAcqInCycle, cycle);
+    if (armed == -2) return 0;
+    if (armed < 0) return -1;
+    const int nbWords = CITIROC_drainCycle(CITIROC_usbID, nbData, cycle);
+    CITIROC_disarm(CITIROC_usbID);
+    return nbWords;
+}
 
-            } 
-            outputFile << line.c_str() << std::endl;
-        }
+static int CITIROC_submitArm(const int CITIROC_usbID, const int nbAcqInCycle, CITIROC_rawCycle* cycle, const bool stopFirst) {
+    static thread_local CITIROC_batch startDAQ;
+    CITIROC_shadow* shadow = &CITIROC_getBoardState(CITIROC_usbID).shadow;
+    const byte word45 = CITIROC_fieldSet(0, CITIROC_regNbAcqInCycle, nbAcqInCycle);
+    byte word22 = 0, previous45 = 0;
+
+    cycle->stamp[CITIROC_STAMP_ARM] = CITIROC_monotonicNs();
+    CITIROC_batchClear(&startDAQ, NULL);
+    if (stopFirst) CITIROC_batchWrite(&startDAQ, 43, CITIROC_wordStopDAQ);
+    // Re-arming with the same size: the stop and start words go out as one transfer
+    if (!stopFirst || !CITIROC_shadowGet(shadow, 45, &previous45) || previous45 != word45) {
+        CITIROC_batchWrite(&startDAQ, 45, word45);
+    }
+    CITIROC_batchWrite(&startDAQ, 43, CITIROC_wordStartDAQ);
+    CITIROC_batchRead(&startDAQ, 22, &word22);
+    const bool submitted = CITIROC_batchSubmit(CITIROC_usbID, &startDAQ, shadow);
+    cycle->armLatency = startDAQ.latency;
+    cycle->stamp[CITIROC_STAMP_READY] = CITIROC_monotonicNs();
+    cycle->nbAcq = nbAcqInCycle;
+    if (!submitted) {
+        CITIROC_disarm(CITIROC_usbID);
+        return -2;
+    }
+    if (word22 != 0) {
+        CITIROC_disarm(CITIROC_usbID);
+        return -1;
+    }
+    return 0;
+}
 
-        // long fifoHG_int[2*nbData],    fifoLG_int[2*nbData];
-        // char fifoHG_char[2*nbData],   fifoLG_char[2*nbData];
-        // int  fifoHG_bits[2*8*nbData], fifoLG_bits[2*8*nbData];
-        // convertFIFO(fifoHG, gainSize, &fifoHG_char, &fifoHG_bits);
-        // convertFIFO(fifoLG, 2*nbData, &fifoLG_char, &fifoLG_bits);
-
-        // printf("======== Cycle %d:\n", cycle);
-        // printf("fifoHG: ");
-        // for (int j=0; j < gainSize; j++) {
-        //         printf("%i, %u\n", j, fifoHG[j]);
-        //         printf(", %d", fifoHG[j]);
-        //         char final[1024];
-        //         int bits[8];
-        //         sprintf(final, "0x%x", (unsigned char)fifoHG[j]);
-        //         long ret = strtol(final, NULL, 16);
-        //         CITIROC_convertToBits(ret, 8, bits);
-        //         printf("%i, %d, %ld, ", j, fifoHG[j], ret);
-        //         for (int k=0; k < 8; k++) {
-        //             printf("%i", bits[k]);
-        //             fifoHG_bits[j*8+k] = bits[k];
-        //         }
-        //         printf("\n");
-        //     }
-
-        // int dataHG[NbChannels];
-        // for (int j=0; j<nbAcqInCycle; j++) {
-        //     for (int chn=0; chn<NbChannels+1; chn++) {
-        //         int boolArrayDataHG[] = {
-        //             fifoHG_bits[j*528 + chn*16+0],
-        //             fifoHG_bits[j*528 + chn*16+1],     
-        //             fifoHG_bits[j*528 + chn*16+2],     
-        //             fifoHG_bits[j*528 + chn*16+3],     
-        //             fifoHG_bits[j*528 + chn*16+4],     
-        //             fifoHG_bits[j*528 + chn*16+5],     
-        //             fifoHG_bits[j*528 + chn*16+6],     
-        //             fifoHG_bits[j*528 + chn*16+7],     
-        //             fifoHG_bits[j*528 + chn*16+8],     
-        //             fifoHG_bits[j*528 + chn*16+9],     
-        //             fifoHG_bits[j*528 + chn*16+10],     
-        //         };
-        //         dataHG[chn] = fifoHG_bits[0];
-        //     }
-        // }
+int CITIROC_armCycle(const int CITIROC_usbID, const int nbAcqInCycle, CITIROC_rawCycle* cycle) {
+    /**
+     * First step of CITIROC_readCycle: arm the board for nbAcqInCycle
+     * acquisitions (subaddresses 45, 43) and check subaddress 22.
+     * @return 0 if armed, -1 if subaddress 22 asks for a new cycle,
+     *         -2 if a transfer failed (the board is then disarmed, if possible).
+     */
+    return CITIROC_submitArm(CITIROC_usbID, nbAcqInCycle, cycle, false);
+}
 
-    
+int CITIROC_rearmCycle(const int CITIROC_usbID, const int nbAcqInCycle, CITIROC_rawCycle* cycle) {
+    /**
+     * Disarm the cycle just drained and arm the next one in the same
+     * batch (subaddresses 43, 45, 43, 22), for free-running acquisition.
+     * Subaddress 45 is skipped if the shadow already holds the size.
+     * @return as CITIROC_armCycle.
+     */
+    return CITIROC_submitArm(CITIROC_usbID, nbAcqInCycle, cycle, true);
+}
 
-    CITIROC_sendWord(CITIROC_usbID, 43, "00000000");
+int CITIROC_drainCycle(const int CITIROC_usbID, const int nbData, CITIROC_rawCycle* cycle) {
+    /**
+     * Second step of CITIROC_readCycle: read nbData bytes from each FIFO
+     * (subaddresses 20, 21, 23, 24), blocking until they are filled
+     * or the read timeout expires. The board stays armed:
+     * CITIROC_disarm or CITIROC_rearmCycle it next.
+     * @return number of complete words read, 0 on timeout.
+     */
+    static const char fifoSubAddress[4] = {20, 21, 23, 24};
+    int nbWords = nbData;
+    for (int k=0; k<4; k++) {
+        if ((int)cycle->fifo[k].size() < nbData) cycle->fifo[k].resize(nbData);
+        cycle->nbBytes[k] = CITIROC_usbRead(CITIROC_usbID, fifoSubAddress[k], cycle->fifo[k].data(), nbData);
+        cycle->stamp[CITIROC_STAMP_FIFO20 + k] = CITIROC_monotonicNs();
+        if (cycle->nbBytes[k] < nbWords) nbWords = cycle->nbBytes[k];
     }
-    outputFile.close();
+    if (nbWords < 0) nbWords = 0;
+
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    cycle->timestamp = (long long)(now.tv_sec)*1000 + (int)now.tv_usec/1000;
+    cycle->hostTime  = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    cycle->nbWords = nbWords;
+    return nbWords;
+}
 
-    return readBytes20;
-}
\ No newline at end of file
+bool CITIROC_disarm(const int CITIROC_usbID) {
+    /**
+     * Stop the acquisition armed by CITIROC_armCycle (subaddress 43).
+     * @return true if the word was written.
+     */
+    return CITIROC_writeRegister(CITIROC_usbID, 43, CITIROC_wordStopDAQ);
+}
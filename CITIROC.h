@@ -8,11 +8,29 @@
 #include <fstream>
 #include <iostream>
 #include <string>
-#include "ftd2xx.h"
-#include "LALUsb.h"
+#include <sys/time.h>
 #include "odbxx.h"
+#include "CITIROC_decoder.h"
+#include "CITIROC_transport.h"
+#include "CITIROC_emulator.h"
+#include "CITIROC_acquisition.h"
+#include "CITIROC_asic.h"
+#include "CITIROC_registers.h"
+#include "CITIROC_writer.h"
+#include "CITIROC_config.h"
+#include "CITIROC_scan.h"
+#include "CITIROC_histogram.h"
+#include "CITIROC_sparse.h"
+#include "CITIROC_pedestal.h"
+#include "CITIROC_compress.h"
+#include "CITIROC_builder.h"
+#include "CITIROC_latency.h"
+#include "CITIROC_statistics.h"
+#include "CITIROC_poller.h"
 
+#ifndef CITIROC_DEBUG_FLAG
 #define CITIROC_DEBUG_FLAG true
+#endif
 
 // Byte -> 8 bits -> unsigned char.
 typedef unsigned char byte;
@@ -22,6 +40,7 @@ typedef unsigned char byte;
 const char odbdir_DAQ[1024]  = "/Equipment/Citiroc1A_DAQ";
 const char odbdir_HV[1024]   = "/Equipment/Citiroc1A_HV";
 const char odbdir_temp[1024] = "/Equipment/Citiroc1A_Slow/Temperature";
+const char odbdir_statistics[1024] = "/Equipment/Citiroc1A_Slow/Statistics";
 const char odbdir_asic_addresses[1024] = "/Equipment/Citiroc1A_Slow/ASIC_addresses";
 const char odbdir_asic_values[1024] = "/Equipment/Citiroc1A_Slow/ASIC_values";
 const char odbdir_asic_sizes[1024] = "/Equipment/Citiroc1A_Slow/ASIC_sizes";
@@ -35,6 +54,17 @@ const char odb_temp_configb = "Temp.-sensor configuration b";
 const char odb_txsize = "FIFO write size";
 const char odb_rxsize = "FIFO read size";
 
+// State kept by the API for each open board, see CITIROC_getBoardState.
+struct CITIROC_boardState {
+    CITIROC_asicImage asic;        // last ASIC configuration sent
+    uint64_t fingerprint = 0;      // configuration confirmed by the board
+    uint64_t asicFingerprint = 0;  // ASIC image part of it
+    uint64_t generation  = 0;      // CITIROC_config snapshot it comes from
+    bool     configured  = false;  // fingerprint matches the board
+    CITIROC_shadow shadow;         // FPGA registers written by this process
+};
+
+
 // Public methods/ functions
 int  CITIROC_connect(char* CITIROC_serialNumber);
 bool CITIROC_initialize(const int CITIROC_usbID);
@@ -43,14 +73,27 @@ bool CITIROC_disconnet(const int CITIROC_usbID);
 bool CITIROC_sendWord(const int CITIROC_usbID, const char subAddress, const char* bitArray);
 bool CITIROC_sendWords(const int CITIROC_usbID, const char subAddress, char* asicString, const int wordCount);
 bool CITIROC_sendASIC(const int CITIROC_usbID);
-bool CITIROC_writeASIC(const int CITIROC_usbID, std::vector<int> asicVector, const int numberOfWords);
+bool CITIROC_writeASIC(const int CITIROC_usbID, const byte* asicWords, const int numberOfWords);
 bool CITIROC_convertToBits(int n, const int numberOfBits, int* binary);
 bool CITIROC_readWord(const int CITIROC_usbID, const char subAddress, char* word, const int wordCount);
 bool CITIROC_readString(const int CITIROC_usbID, const char subAddress, std::string* wordString);
 int  CITIROC_readFIFO(const int CITIROC_usbID, int* dataLG, int* dataHG, int* totalHits, int run_number);
+int  CITIROC_readCycle(const int CITIROC_usbID, const int nbAcqInCycle, const int nbData, CITIROC_rawCycle* cycle);
+int  CITIROC_armCycle(const int CITIROC_usbID, const int nbAcqInCycle, CITIROC_rawCycle* cycle);
+int  CITIROC_rearmCycle(const int CITIROC_usbID, const int nbAcqInCycle, CITIROC_rawCycle* cycle);
+int  CITIROC_drainCycle(const int CITIROC_usbID, const int nbData, CITIROC_rawCycle* cycle);
+bool CITIROC_disarm(const int CITIROC_usbID);
+bool CITIROC_getGeometry(CITIROC_geometry* geometry);
 bool CITIROC_readFIFO_fixedAcqNumber(const int CITIROC_usbID, char* fifoHG, char* fifoLG);
 bool CITIROC_printWord(char subAddress, char word, int wordCount);
 bool CITIROC_readFPGASubAddress(const int usbId, const char subAddress);
+bool CITIROC_readRegister(const int CITIROC_usbID, const char subAddress, byte* value);
+bool CITIROC_writeRegister(const int CITIROC_usbID, const char subAddress, const byte value);
+int  CITIROC_auditRegisters(const int CITIROC_usbID);
 bool CITIROC_sendFirmwareSettings(const int CITIROC_usbId);
+bool CITIROC_getFirmwareWords(const CITIROC_config& config, byte* words);
+bool CITIROC_sendConfiguration(const int CITIROC_usbID);
+bool CITIROC_sendASICValue(const int CITIROC_usbID, const int field, const int index, const int value);
 void CITIROC_raiseException();
+CITIROC_boardState& CITIROC_getBoardState(const int CITIROC_usbID);
 #endif 
\ No newline at end of file
@@ -0,0 +1,335 @@
+/* Acquisition thread decoupling the board readout from MIDAS */
+#include "CITIROC.h"
+#include <algorithm>
+#include <chrono>
+
+static int CITIROC_nextCycleSize(CITIROC_acquisition* acquisition, const uint64_t nbAcqDone) {
+    /**
+     * @return acquisitions to arm for the next cycle, 0 once geometry.nbAcq are read.
+     */
+    const CITIROC_geometry& geometry = acquisition->geometry;
+    int nbAcqInCycle = geometry.nbAcqInCycle;
+    if (geometry.nbAcq > 0) {
+        if (nbAcqDone >= (uint64_t)geometry.nbAcq) return 0;
+        if ((uint64_t)nbAcqInCycle > geometry.nbAcq - nbAcqDone) nbAcqInCycle = geometry.nbAcq - nbAcqDone;
+    }
+    if (acquisition->scan.active && nbAcqInCycle > CITIROC_scanRemaining(&acquisition->scan)) nbAcqInCycle = CITIROC_scanRemaining(&acquisition->scan);
+    return nbAcqInCycle;
+}
+
+static void CITIROC_acquisitionLoop(CITIROC_acquisition* acquisition) {
+    /**
+     * Arm, read and queue cycles until CITIROC_stopAcquisition,
+     * or until geometry.nbAcq acquisitions are read.
+     * When the ring is full the board is left idle
+     * until the readout releases a slot.
+     * Reconfiguration requests are served before arming the next cycle,
+     * and the next cycle queued carries their latency.
+     * During a scan, cycles stop at the end of each point,
+     * and the next point is sent to the board once the cycle is queued.
+     * With adaptive polling, the end of each cycle is awaited with
+     * CITIROC_pollCycleDone before the FIFOs are read; a cycle still
+     * filling when the thread is stopped is disarmed and dropped.
+     * Free running, the next cycle is armed as soon as the previous one
+     * is queued, while the readout decodes it, if a slot is free and
+     * no reconfiguration, scan step or end of run is due.
+     * The board counts as live from the end of arming to the end of each cycle queued.
+     */
+    const CITIROC_geometry& geometry = acquisition->geometry;
+    CITIROC_boardState& state = CITIROC_getBoardState(acquisition->usbID);
+    const bool adaptive = acquisition->poller.config.mode == CITIROC_POLL_ADAPTIVE;
+    uint64_t nbAcqDone   = acquisition->acquisitions.load();  // carried over a pause
+    double   reconfigLatency = 0.;
+    bool     armed = false;  // next cycle armed by CITIROC_rearmCycle
+    CITIROC_scan* scan = &acquisition->scan;
+
+    if (acquisition->finished) return;
+    if (scan->active) CITIROC_scanApply(acquisition->usbID, scan);
+
+    while (acquisition->running.load(std::memory_order_relaxed)) {
+        if (!armed && acquisition->reconfigure.exchange(false)) {
+            if (!CITIROC_sendConfiguration(acquisition->usbID)) acquisition->reconfigureErrors++;
+            if (scan->active) CITIROC_scanApply(acquisition->usbID, scan);
+            const long long now = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+            reconfigLatency += now - acquisition->reconfigureRequest.load();
+            acquisition->reconfigurations++;
+        }
+
+        const int nbAcqNext = CITIROC_nextCycleSize(acquisition, nbAcqDone);
+        if (!armed && nbAcqNext == 0) break;
+
+        CITIROC_rawCycle* cycle = acquisition->ring.writeSlot();
+        if (cycle == NULL) {
+            acquisition->ringFull++;
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+            continue;
+        }
+        if (!armed) {
+            const int status = CITIROC_armCycle(acquisition->usbID, nbAcqNext, cycle);
+            if (status == -2) {
+                acquisition->armErrors++;
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+                continue;
+            }
+            if (status < 0)   {acquisition->restarts++;  continue;}
+        }
+        armed = false;
+        // Every cycle armed takes a number, so a cycle lost to a timeout
+        // leaves a gap instead of shifting the matching of later cycles
+        cycle->cycleNumber = acquisition->cycleNumber++;
+        const int nbAcqInCycle = cycle->nbAcq;
+        const int nbData = CITIROC_WORDS_PER_ACQ * nbAcqInCycle;
+
+        uint64_t doneTime = 0;
+        if (adaptive) {
+            int done = 0;
+            while (done == 0 && acquisition->running.load(std::memory_order_relaxed)) {
+                done = CITIROC_pollCycleDone(acquisition->usbID, &acquisition->poller, nbAcqInCycle, cycle->stamp[CITIROC_STAMP_ARM], &doneTime);
+            }
+            if (done <= 0) {
+                CITIROC_disarm(acquisition->usbID);
+                if (done < 0) acquisition->timeouts++;
+                continue;
+            }
+        }
+        const int nbWords = CITIROC_drainCycle(acquisition->usbID, nbData, cycle);
+        bool shortRead = false;
+        for (int k=0; k<4; k++) {
+            if (cycle->nbBytes[k] > 0) acquisition->fifoBytes[k].fetch_add(cycle->nbBytes[k], std::memory_order_relaxed);
+            shortRead |= cycle->nbBytes[k] != nbData;
+        }
+        if (shortRead) acquisition->shortReads++;
+        if (nbWords == 0) {
+            CITIROC_disarm(acquisition->usbID);
+            acquisition->timeouts++;
+            continue;
+        }
+        if (!acquisition->freeRunning) CITIROC_disarm(acquisition->usbID);
+
+        CITIROC_latenciesRecord(&acquisition->latency, cycle->stamp, CITIROC_STAMP_ARM, CITIROC_STAMP_FIFO24);
+        cycle->configGeneration = state.generation;
+        cycle->reconfigLatency  = reconfigLatency;
+        const bool pointDone    = scan->active && CITIROC_scanCount(scan, cycle->fifo[0].data(), nbWords / CITIROC_WORDS_PER_ACQ);
+        cycle->scanPointDone    = pointDone;
+        if (pointDone) cycle->scanPoint = scan->point;
+        reconfigLatency = 0.;
+        // Blocking reads return once the cycle is complete and FIFO 20 is transferred:
+        // take off the transfer, estimated as that of FIFO 21, of the same size
+        const uint64_t transfer = cycle->stamp[CITIROC_STAMP_FIFO21] - cycle->stamp[CITIROC_STAMP_FIFO20];
+        const uint64_t endTime  = adaptive ? doneTime : cycle->stamp[CITIROC_STAMP_FIFO20] - transfer;
+        if (endTime > cycle->stamp[CITIROC_STAMP_READY]) acquisition->liveTime.fetch_add(endTime - cycle->stamp[CITIROC_STAMP_READY], std::memory_order_relaxed);
+        acquisition->ring.commit();
+        acquisition->cycles++;
+        nbAcqDone += nbWords / CITIROC_WORDS_PER_ACQ;
+        acquisition->acquisitions.store(nbAcqDone);
+
+        if (acquisition->freeRunning) {
+            const int nbAcqFollowing = CITIROC_nextCycleSize(acquisition, nbAcqDone);
+            CITIROC_rawCycle* next = NULL;
+            if (nbAcqFollowing > 0 && !pointDone && !acquisition->reconfigure.load() && acquisition->running.load(std::memory_order_relaxed)) {
+                next = acquisition->ring.writeSlot();
+            }
+            const int status = (next == NULL) ? 1 : CITIROC_rearmCycle(acquisition->usbID, nbAcqFollowing, next);
+            if (status == 1) CITIROC_disarm(acquisition->usbID);
+            else if (status == 0)  armed = true;
+            else if (status == -2) acquisition->armErrors++;
+            else acquisition->restarts++;
+        }
+
+        if (pointDone && !CITIROC_scanNext(acquisition->usbID, scan)) {
+            acquisition->finished = true;
+            break;
+        }
+    }
+    if (armed) CITIROC_disarm(acquisition->usbID);
+
+    if (geometry.nbAcq > 0 && nbAcqDone >= (uint64_t)geometry.nbAcq) {
+        printf("CITIROC: %llu acquisitions read, board left idle.\n", (unsigned long long)nbAcqDone);
+        acquisition->finished = true;
+    }
+}
+
+static void CITIROC_compressionLoop(CITIROC_acquisition* acquisition) {
+    /**
+     * Compress the cycles queued by the acquisition thread
+     * before the readout sees them, until CITIROC_stopAcquisition
+     * and the last cycle it queued.
+     */
+    for (;;) {
+        CITIROC_rawCycle* cycle = acquisition->ring.stageSlot();
+        if (cycle == NULL) {
+            // Look again once the acquisition thread is known to be done:
+            // it may have queued its last cycle since the first look
+            if (!acquisition->producing.load()) {
+                if (acquisition->ring.stageSlot() != NULL) continue;
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+            continue;
+        }
+        const int nbAcq = cycle->nbWords / CITIROC_WORDS_PER_ACQ;
+        const unsigned char* fifo[4] = {cycle->fifo[0].data(), cycle->fifo[1].data(),
+                                        cycle->fifo[2].data(), cycle->fifo[3].data()};
+        if (CITIROC_compressCycle(fifo, nbAcq, acquisition->codec, acquisition->level, &cycle->compressed) < 0) {
+            cycle->compressed.clear();
+        }
+        acquisition->rawBytes        += 4 * nbAcq * CITIROC_WORDS_PER_ACQ;
+        acquisition->compressedBytes += cycle->compressed.size();
+        acquisition->ring.stageCommit();
+    }
+}
+
+void CITIROC_resetAcquisition(CITIROC_acquisition* acquisition) {
+    /**
+     * Zero the counters, live time, latencies and cycle numbers
+     * at the start of a run, and drop a pending reconfiguration:
+     * the settings are sent with the run. CITIROC_startAcquisition keeps them,
+     * so that a paused and resumed run still adds up as a whole.
+     * Call it while the acquisition thread is stopped.
+     */
+    acquisition->cycles       = 0;
+    acquisition->acquisitions = 0;
+    acquisition->cycleNumber  = 0;
+    acquisition->restarts     = 0;
+    acquisition->timeouts     = 0;
+    acquisition->ringFull     = 0;
+    acquisition->shortReads   = 0;
+    acquisition->armErrors    = 0;
+    for (int k=0; k<4; k++) acquisition->fifoBytes[k] = 0;
+    acquisition->reconfigurations  = 0;
+    acquisition->reconfigureErrors = 0;
+    acquisition->reconfigure       = false;
+    acquisition->rawBytes        = 0;
+    acquisition->compressedBytes = 0;
+    acquisition->droppedCycles   = 0;
+    acquisition->finished     = false;
+    acquisition->liveTime     = 0;
+    acquisition->startTime    = CITIROC_monotonicNs();
+    acquisition->stopTime     = 0;
+    CITIROC_latenciesReset(&acquisition->latency);
+}
+
+bool CITIROC_startAcquisition(CITIROC_acquisition* acquisition, const int CITIROC_usbID,
+                              const CITIROC_geometry& geometry, const int ringSize) {
+    /**
+     * Start the acquisition thread, at the start of a run
+     * after CITIROC_resetAcquisition, or to resume it. The FIFO buffers of the ring
+     * are sized here for geometry.nbAcqInCycle acquisitions.
+     * @param geometry: see CITIROC_getGeometry.
+     * @param ringSize: number of cycles buffered for the readout.
+     * @return false if already running or arguments are out of range.
+     */
+    if (acquisition->running) return false;
+    if (geometry.nbAcqInCycle < 1 || geometry.nbAcqInCycle > CITIROC_MAX_ACQ_IN_CYCLE || ringSize < 1) return false;
+
+    acquisition->usbID    = CITIROC_usbID;
+    acquisition->geometry = geometry;
+    const bool compress = acquisition->codec != CITIROC_CODEC_NONE;
+    acquisition->ring.resize(ringSize, compress);
+    const size_t nbData = CITIROC_WORDS_PER_ACQ * geometry.nbAcqInCycle;
+    acquisition->ring.forEach([nbData, compress](CITIROC_rawCycle& cycle) {
+        for (int k=0; k<4; k++) cycle.fifo[k].resize(nbData);
+        cycle.compressed.clear();
+        if (compress) cycle.compressed.reserve(sizeof(CITIROC_compressHeader) + 5 * nbData + 1024);
+    });
+    acquisition->stopTime     = 0;
+    if (acquisition->startTime == 0) acquisition->startTime = CITIROC_monotonicNs();
+
+    printf("CITIROC: Starting %sacquisition thread (%d acquisitions per cycle, %d cycles buffered)\n",
+           acquisition->freeRunning ? "free-running " : "", geometry.nbAcqInCycle, ringSize);
+    acquisition->running   = true;
+    acquisition->producing = true;
+    acquisition->thread  = std::thread(CITIROC_acquisitionLoop, acquisition);
+    if (compress) acquisition->compressor = std::thread(CITIROC_compressionLoop, acquisition);
+    return true;
+}
+
+void CITIROC_stopAcquisition(CITIROC_acquisition* acquisition) {
+    /**
+     * Stop the acquisition thread after its current cycle.
+     * The cycles already queued are compressed if need be and stay
+     * in the ring for the readout, until CITIROC_discardCycles
+     * or the next CITIROC_startAcquisition.
+     */
+    if (!acquisition->running) return;
+    acquisition->running = false;
+    if (acquisition->thread.joinable()) acquisition->thread.join();
+    acquisition->producing = false;
+    if (acquisition->compressor.joinable()) acquisition->compressor.join();
+    acquisition->stopTime = CITIROC_monotonicNs();
+    if (acquisition->rawBytes > 0) {
+        printf("CITIROC: %llu FIFO bytes compressed to %llu\n",
+               (unsigned long long)acquisition->rawBytes.load(), (unsigned long long)acquisition->compressedBytes.load());
+    }
+    printf("CITIROC: Acquisition thread stopped after %u cycles (%u restarts, %u timeouts, %u arming errors, %u short reads, %u full ring, %u reconfigurations)\n",
+           acquisition->cycles.load(), acquisition->restarts.load(),
+           acquisition->timeouts.load(), acquisition->armErrors.load(), acquisition->shortReads.load(),
+           acquisition->ringFull.load(), acquisition->reconfigurations.load());
+    const uint64_t runTime = CITIROC_runTime(acquisition);
+    printf("CITIROC: Live %.3f s of %.3f s (%.2f%%), dead %.3f s\n",
+           1e-9 * acquisition->liveTime.load(), 1e-9 * runTime,
+           (runTime > 0) ? 100. * acquisition->liveTime.load() / runTime : 0.,
+           1e-9 * (runTime - std::min<uint64_t>(acquisition->liveTime.load(), runTime)));
+    if (acquisition->poller.config.mode == CITIROC_POLL_ADAPTIVE) {
+        printf("CITIROC: %llu status polls, %llu cycles complete at the first poll, %.1f us fill time per acquisition\n",
+               (unsigned long long)acquisition->poller.polls.load(), (unsigned long long)acquisition->poller.overslept.load(),
+               1e-3 * acquisition->poller.fillPerAcq.load());
+    }
+}
+
+uint32_t CITIROC_discardCycles(CITIROC_acquisition* acquisition) {
+    /**
+     * Empty the ring of a stopped acquisition, e.g. when the readout
+     * could not bank its last cycles before the end of the run.
+     * Cycles returned by CITIROC_nextCycle and not released yet go too.
+     * @return cycles discarded, also added to droppedCycles.
+     */
+    uint32_t nbCycles = 0;
+    while (acquisition->ring.readSlot() != NULL) {
+        acquisition->ring.release();
+        nbCycles++;
+    }
+    acquisition->droppedCycles += nbCycles;
+    return nbCycles;
+}
+
+uint64_t CITIROC_runTime(const CITIROC_acquisition* acquisition) {
+    /**
+     * @return time since CITIROC_resetAcquisition, pauses included
+     *         (they count as dead time), up to the last CITIROC_stopAcquisition
+     *         once stopped, ns; 0 if never started.
+     */
+    const uint64_t start = acquisition->startTime.load();
+    if (start == 0) return 0;
+    const uint64_t stop = acquisition->stopTime.load();
+    const uint64_t end  = (stop >= start) ? stop : CITIROC_monotonicNs();
+    return end - start;
+}
+
+void CITIROC_requestReconfiguration(CITIROC_acquisition* acquisition) {
+    /**
+     * Ask the acquisition thread to bring the board up to date with the
+     * current CITIROC_config snapshot, see CITIROC_sendConfiguration.
+     * The thread does it between two cycles, so no cycle is armed
+     * across the change. Requests made before it gets to them are merged,
+     * and the latency is counted from the first one.
+     * Made while the thread is stopped, e.g. during a pause, the request
+     * is served before the first cycle after CITIROC_startAcquisition.
+     */
+    if (!acquisition->reconfigure.load()) {
+        acquisition->reconfigureRequest = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+    acquisition->reconfigure = true;
+}
+
+CITIROC_rawCycle* CITIROC_nextCycle(CITIROC_acquisition* acquisition) {
+    /**
+     * @return oldest cycle read by the acquisition thread, NULL if none.
+     * Call CITIROC_releaseCycle once done with it.
+     */
+    return acquisition->ring.readSlot();
+}
+
+void CITIROC_releaseCycle(CITIROC_acquisition* acquisition) {
+    acquisition->ring.release();
+}
@@ -0,0 +1,181 @@
+#ifndef CITIROC_ACQUISITION_H
+#define CITIROC_ACQUISITION_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "CITIROC_scan.h"
+#include "CITIROC_compress.h"
+#include "CITIROC_latency.h"
+#include "CITIROC_poller.h"
+
+// Raw FIFO bytes of one acquisition cycle, as read from
+// subaddresses 20, 21, 23 and 24 (see CITIROC_decoder.h).
+struct CITIROC_rawCycle {
+    int nbAcq   = 0;            // acquisitions armed at subaddress 45
+    int nbWords = 0;            // complete words read from all four FIFOs
+    int nbBytes[4] = {};        // bytes read from each FIFO
+    std::vector<unsigned char> fifo[4];
+    uint32_t  cycleNumber = 0;
+    long long timestamp   = 0;  // host time at the end of the readout, ms
+    long long hostTime    = 0;  // steady clock at the end of the readout, us
+    double    armLatency  = 0.; // arming transfers (subaddresses 45, 43, 22), us
+    uint64_t  stamp[CITIROC_NB_STAMPS] = {};  // CITIROC_STAMP_ARM to CITIROC_STAMP_FIFO24 set by CITIROC_armCycle and CITIROC_drainCycle, ns
+    uint64_t  configGeneration = 0;  // CITIROC_config snapshot held by the board
+    double    reconfigLatency  = 0.; // live reconfiguration before this cycle, us, 0 if none
+    bool      scanPointDone    = false;  // last cycle of a scan point
+    CITIROC_scanPoint scanPoint;          // valid if scanPointDone
+    std::vector<unsigned char> compressed;  // see CITIROC_compressCycle, empty if not compressed
+};
+
+// Lock-free ring of preallocated slots,
+// for exactly one producer thread and one consumer thread.
+// With staged set, a third thread processes each slot
+// between the producer and the consumer (stageSlot, stageCommit).
+template <class T>
+class CITIROC_ring {
+public:
+    void resize(const size_t capacity, const bool withStage = false) {
+        // One slot is kept empty to tell a full ring from an empty one.
+        slots.resize(capacity + 1);
+        staged = withStage;
+        head.store(0);
+        middle.store(0);
+        tail.store(0);
+    }
+
+    // Producer: slot to fill, NULL if the ring is full.
+    T* writeSlot() {
+        const size_t h = head.load(std::memory_order_relaxed);
+        if ((h + 1) % slots.size() == tail.load(std::memory_order_acquire)) return NULL;
+        return &slots[h];
+    }
+
+    // Producer: publish the slot returned by writeSlot.
+    void commit() {
+        const size_t h = head.load(std::memory_order_relaxed);
+        head.store((h + 1) % slots.size(), std::memory_order_release);
+    }
+
+    // Stage: oldest slot published by the producer and not processed yet, NULL if none.
+    T* stageSlot() {
+        const size_t m = middle.load(std::memory_order_relaxed);
+        if (m == head.load(std::memory_order_acquire)) return NULL;
+        return &slots[m];
+    }
+
+    // Stage: hand the slot returned by stageSlot to the consumer.
+    void stageCommit() {
+        const size_t m = middle.load(std::memory_order_relaxed);
+        middle.store((m + 1) % slots.size(), std::memory_order_release);
+    }
+
+    // Consumer: oldest published slot, NULL if the ring is empty.
+    T* readSlot() {
+        const size_t t = tail.load(std::memory_order_relaxed);
+        if (t == ready()) return NULL;
+        return &slots[t];
+    }
+
+    // Consumer: hand the slot returned by readSlot back to the producer.
+    void release() {
+        const size_t t = tail.load(std::memory_order_relaxed);
+        tail.store((t + 1) % slots.size(), std::memory_order_release);
+    }
+
+    // Apply f to every slot, e.g. to preallocate them. Not thread safe.
+    template <class F>
+    void forEach(F f) {
+        for (T& slot: slots) f(slot);
+    }
+
+    bool empty() const {
+        return tail.load(std::memory_order_acquire) == ready();
+    }
+
+    // Every slot is waiting for the consumer: the producer is stalled.
+    bool full() const {
+        return (head.load(std::memory_order_acquire) + 1) % slots.size() == tail.load(std::memory_order_acquire);
+    }
+
+private:
+    // End of the slots the consumer may read.
+    size_t ready() const {
+        return staged ? middle.load(std::memory_order_acquire) : head.load(std::memory_order_acquire);
+    }
+
+    std::vector<T> slots;
+    bool staged = false;
+    std::atomic<size_t> head{0};
+    std::atomic<size_t> middle{0};
+    std::atomic<size_t> tail{0};
+};
+
+// Acquisition geometry of a run, see CITIROC_getGeometry.
+struct CITIROC_geometry {
+    int nbAcqInCycle = 100;  // acquisitions armed per cycle (subaddress 45), 1 to 255
+    int nbAcq        = 0;    // acquisitions per run, 0 for no limit
+    int nbChannels   = 32;   // channels sent to the MIDAS banks, 1 to 32
+};
+
+// Acquisition thread: arms the board, drains the FIFOs
+// and queues the raw cycles for the MIDAS readout.
+struct CITIROC_acquisition {
+    int usbID        = 0;
+    CITIROC_geometry geometry;
+    CITIROC_ring<CITIROC_rawCycle> ring;
+    CITIROC_scan      scan;   // set up with CITIROC_scanConfigure before the start
+    int               codec = 0;  // CITIROC_CODEC_*, set before the start
+    int               level = 1;  // zlib level
+    CITIROC_poller    poller;     // set up with CITIROC_pollerReset before the start
+    bool              freeRunning = false;  // re-arm as soon as a cycle is queued, set before the start
+    std::thread       thread;
+    std::thread       compressor; // runs if codec is set
+    std::atomic<bool> running{false};
+    std::atomic<bool> producing{false};  // acquisition thread not joined yet: the compressor waits for it
+    std::atomic<bool> finished{false};  // geometry.nbAcq acquisitions read, or scan over
+    uint32_t          cycleNumber = 0;  // of the next cycle armed, written by the acquisition thread
+
+    // Set by CITIROC_requestReconfiguration, served between cycles.
+    std::atomic<bool>      reconfigure{false};
+    std::atomic<long long> reconfigureRequest{0};  // steady clock, us
+
+    // Counters of the run, written by the acquisition thread only,
+    // zeroed by CITIROC_resetAcquisition.
+    std::atomic<uint32_t> cycles{0};
+    std::atomic<uint64_t> acquisitions{0};
+    std::atomic<uint32_t> restarts{0};
+    std::atomic<uint32_t> timeouts{0};
+    std::atomic<uint32_t> ringFull{0};
+    std::atomic<uint32_t> shortReads{0};       // cycles with a FIFO read short of the bytes armed
+    std::atomic<uint32_t> armErrors{0};        // arming transfers that failed (CITIROC_armCycle returned -2)
+    std::atomic<uint64_t> fifoBytes[4] = {};   // bytes read from FIFOs 20, 21, 23, 24
+    std::atomic<uint32_t> reconfigurations{0};
+    std::atomic<uint32_t> reconfigureErrors{0};
+    std::atomic<uint64_t> rawBytes{0};         // FIFO bytes compressed
+    std::atomic<uint64_t> compressedBytes{0};  // their compressed size
+    std::atomic<uint32_t> droppedCycles{0};    // left in the ring at a stop or pause, see CITIROC_discardCycles
+
+    // Live time: from arming to the end of each cycle queued, ns.
+    // Dead time is the rest of CITIROC_runTime.
+    std::atomic<uint64_t> liveTime{0};
+    std::atomic<uint64_t> startTime{0};  // CITIROC_monotonicNs at the start of the run
+    std::atomic<uint64_t> stopTime{0};   // at the last stop, 0 while running
+
+    // Per-stage latencies of the cycles; the readout records its own stages.
+    CITIROC_latencies latency;
+};
+
+// Public methods/ functions
+void CITIROC_resetAcquisition(CITIROC_acquisition* acquisition);
+bool CITIROC_startAcquisition(CITIROC_acquisition* acquisition, const int CITIROC_usbID,
+                              const CITIROC_geometry& geometry, const int ringSize);
+void CITIROC_stopAcquisition(CITIROC_acquisition* acquisition);
+uint32_t CITIROC_discardCycles(CITIROC_acquisition* acquisition);
+uint64_t CITIROC_runTime(const CITIROC_acquisition* acquisition);
+void CITIROC_requestReconfiguration(CITIROC_acquisition* acquisition);
+CITIROC_rawCycle* CITIROC_nextCycle(CITIROC_acquisition* acquisition);
+void CITIROC_releaseCycle(CITIROC_acquisition* acquisition);
+#endif
@@ -0,0 +1,85 @@
+/* Packed ASIC configuration built from the ODB ASIC_values */
+#include "CITIROC_asic.h"
+#include <stdio.h>
+#include <string.h>
+
+int CITIROC_asicFindField(const char* name) {
+    /**
+     * @return index of name in CITIROC_asicFields, -1 if unknown.
+     */
+    for (int i=0; i<CITIROC_NB_ASIC_FIELDS; i++) {
+        if (strcmp(CITIROC_asicFields[i].name, name) == 0) return i;
+    }
+    return -1;
+}
+
+static inline void CITIROC_asicSetBit(CITIROC_asicImage* image, const int position, const int bit) {
+    const int b = CITIROC_ASIC_BITS - 1 - position;
+    if (bit) image->packed[b/8] |=  (1 << (b%8));
+    else     image->packed[b/8] &= ~(1 << (b%8));
+}
+
+int CITIROC_asicGetBit(const CITIROC_asicImage* image, const int position) {
+    const int b = CITIROC_ASIC_BITS - 1 - position;
+    return (image->packed[b/8] >> (b%8)) & 1;
+}
+
+void CITIROC_asicSetField(CITIROC_asicImage* image, const int field, const int index, const int value) {
+    /**
+     * Encode one value of a field into the packed image.
+     * As CITIROC_convertToBits, negative values are encoded as 0
+     * and values too large for the field keep their lowest bits.
+     * @param field: index in CITIROC_asicFields.
+     * @param index: channel, 0 to count-1.
+     */
+    const CITIROC_asicField& f = CITIROC_asicFields[field];
+    const unsigned int v = (value < 0) ? 0 : (unsigned int)value;
+    const int base = f.offset + index*f.stride;
+    for (int j=0; j<f.width; j++) {
+        const int bit = f.lsbFirst ? (v >> j) & 1 : (v >> (f.width-1-j)) & 1;
+        CITIROC_asicSetBit(image, base+j, bit);
+    }
+}
+
+int CITIROC_asicUpdateField(CITIROC_asicImage* image, const int field, const std::vector<int>& values) {
+    /**
+     * Re-encode the values of a field which differ from the last encoded ones.
+     * Missing values are encoded as 0.
+     * @return number of re-encoded values.
+     */
+    const CITIROC_asicField& f = CITIROC_asicFields[field];
+    std::vector<int>& cached = image->values[field];
+    const bool first = cached.empty();
+    if (first) cached.assign(f.count, 0);
+
+    int nbChanged = 0;
+    for (int i=0; i<f.count; i++) {
+        const int value = (i < (int)values.size()) ? values[i] : 0;
+        if (!first && cached[i] == value) continue;
+        cached[i] = value;
+        CITIROC_asicSetField(image, field, i, value);
+        nbChanged++;
+    }
+    return nbChanged;
+}
+
+int CITIROC_asicUpdate(CITIROC_asicImage* image, const std::vector<int>* values) {
+    /**
+     * Bring the image up to date with the ASIC values,
+     * e.g. CITIROC_config::asic.
+     * The first call encodes every field.
+     * @param values: CITIROC_NB_ASIC_FIELDS vectors, indexed as CITIROC_asicFields.
+     * @return number of re-encoded values.
+     */
+    int nbChanged = 0;
+    for (int i=0; i<CITIROC_NB_ASIC_FIELDS; i++) {
+        nbChanged += CITIROC_asicUpdateField(image, i, values[i]);
+    }
+    return nbChanged;
+}
+
+void CITIROC_asicPrint(const CITIROC_asicImage* image) {
+    printf("ASIC stack: ");
+    for (int p=0; p<CITIROC_ASIC_BITS; p++) {printf("%d", CITIROC_asicGetBit(image, p));}
+    printf("\n");
+}
@@ -0,0 +1,124 @@
+#ifndef CITIROC_ASIC_H
+#define CITIROC_ASIC_H
+
+#include <vector>
+
+#define CITIROC_ASIC_BITS  1144
+#define CITIROC_ASIC_BYTES 143
+
+// Field of the 1144-bit ASIC configuration: `count` values of `width` bits,
+// the first one at bit `offset` of the stack and the next ones every `stride` bits.
+// Offsets and sizes follow the ASIC_addresses and ASIC_sizes tables at ODB.
+struct CITIROC_asicField {
+    const char* name;
+    int  offset;
+    int  width;
+    int  count;
+    int  stride;
+    bool lsbFirst; // least significant bit first in the stack
+};
+
+constexpr CITIROC_asicField CITIROC_asicFields[] = {
+    {"chn",                   0,  4, 32,  4, true },
+    {"calibDacQ",           128,  4, 32,  4, true },
+    {"enDiscri",            256,  1,  1,  1, false},
+    {"ppDiscri",            257,  1,  1,  1, false},
+    {"latchDiscri",         258,  1,  1,  1, false},
+    {"enDiscriT",           259,  1,  1,  1, false},
+    {"ppDiscriT",           260,  1,  1,  1, false},
+    {"enCalibDacQ",         261,  1,  1,  1, false},
+    {"ppCalibDacQ",         262,  1,  1,  1, false},
+    {"enCalibDacT",         263,  1,  1,  1, false},
+    {"ppCalibDacT",         264,  1,  1,  1, false},
+    {"mask",                265,  1, 32,  1, false},
+    {"ppThHg",              297,  1,  1,  1, false},
+    {"enThHg",              298,  1,  1,  1, false},
+    {"ppThLg",              299,  1,  1,  1, false},
+    {"enThLg",              300,  1,  1,  1, false},
+    {"biasSca",             301,  1,  1,  1, false},
+    {"ppPdetHg",            302,  1,  1,  1, false},
+    {"enPdetHg",            303,  1,  1,  1, false},
+    {"ppPdetLg",            304,  1,  1,  1, false},
+    {"enPdetLg",            305,  1,  1,  1, false},
+    {"scaOrPdHg",           306,  1,  1,  1, false},
+    {"scaOrPdLg",           307,  1,  1,  1, false},
+    {"bypassPd",            308,  1,  1,  1, false},
+    {"selTrigExtPd",        309,  1,  1,  1, false},
+    {"ppFshBuffer",         310,  1,  1,  1, false},
+    {"enFsh",               311,  1,  1,  1, false},
+    {"ppFsh",               312,  1,  1,  1, false},
+    {"ppSshLg",             313,  1,  1,  1, false},
+    {"enSshLg",             314,  1,  1,  1, false},
+    {"shapingTimeLg",       315,  3,  1,  3, true },
+    {"ppSshHg",             318,  1,  1,  1, false},
+    {"enSshHg",             319,  1,  1,  1, false},
+    {"shapingTimeHg",       320,  3,  1,  3, true },
+    {"paLgBias",            323,  1,  1,  1, false},
+    {"ppPaHg",              324,  1,  1,  1, false},
+    {"enPaHg",              325,  1,  1,  1, false},
+    {"ppPaLg",              326,  1,  1,  1, false},
+    {"enPaLg",              327,  1,  1,  1, false},
+    {"fshOnLg",             328,  1,  1,  1, false},
+    {"enInputDac",          329,  1,  1,  1, false},
+    {"dacRef",              330,  1,  1,  1, false},
+    {"inputDac",            331,  8, 32,  9, false},
+    {"sc_cmdInputDac",      339,  1, 32,  9, false},
+    {"paHgGain",            619,  6, 32, 15, true },
+    {"paLgGain",            625,  6, 32, 15, true },
+    {"CtestHg",             631,  1, 32, 15, false},
+    {"CtestLg",             632,  1, 32, 15, false},
+    {"enPa",                633,  1, 32, 15, false},
+    {"ppTemp",             1099,  1,  1,  1, false},
+    {"enTemp",             1100,  1,  1,  1, false},
+    {"ppBg",               1101,  1,  1,  1, false},
+    {"enBg",               1102,  1,  1,  1, false},
+    {"enThresholdDac1",    1103,  1,  1,  1, false},
+    {"ppThresholdDac1",    1104,  1,  1,  1, false},
+    {"enThresholdDac2",    1105,  1,  1,  1, false},
+    {"ppThresholdDac2",    1106,  1,  1,  1, false},
+    {"threshold1",         1107, 10,  1, 10, false},
+    {"threshold2",         1117, 10,  1, 10, false},
+    {"enHgOtaQ",           1127,  1,  1,  1, false},
+    {"ppHgOtaQ",           1128,  1,  1,  1, false},
+    {"enLgOtaQ",           1129,  1,  1,  1, false},
+    {"ppLgOtaQ",           1130,  1,  1,  1, false},
+    {"enProbeOtaQ",        1131,  1,  1,  1, false},
+    {"ppProbeOtaQ",        1132,  1,  1,  1, false},
+    {"testBitOtaQ",        1133,  1,  1,  1, false},
+    {"enValEvtReceiver",   1134,  1,  1,  1, false},
+    {"ppValEvtReceiver",   1135,  1,  1,  1, false},
+    {"enRazChnReceiver",   1136,  1,  1,  1, false},
+    {"ppRazChnReceiver",   1137,  1,  1,  1, false},
+    {"enDigitalMuxOutput", 1138,  1,  1,  1, false},
+    {"enOr32",             1139,  1,  1,  1, false},
+    {"enNor32Oc",          1140,  1,  1,  1, false},
+    {"triggerPolarity",    1141,  1,  1,  1, false},
+    {"enNor32TOc",         1142,  1,  1,  1, false},
+    {"enTriggersOutput",   1143,  1,  1,  1, false},
+};
+
+constexpr int CITIROC_NB_ASIC_FIELDS = sizeof(CITIROC_asicFields) / sizeof(CITIROC_asicFields[0]);
+
+constexpr int CITIROC_asicFieldBits(const int i) {
+    return (i == CITIROC_NB_ASIC_FIELDS) ? 0
+         : CITIROC_asicFields[i].width * CITIROC_asicFields[i].count + CITIROC_asicFieldBits(i + 1);
+}
+static_assert(CITIROC_asicFieldBits(0) == CITIROC_ASIC_BITS, "ASIC field map must cover 1144 bits");
+
+// Packed ASIC configuration, as written to subaddress 10:
+// bit p of the stack is bit (1143-p)%8 of byte (1143-p)/8.
+// values keeps the last encoded value of each field,
+// so only changed values are re-encoded.
+struct CITIROC_asicImage {
+    unsigned char    packed[CITIROC_ASIC_BYTES] = {};
+    std::vector<int> values[CITIROC_NB_ASIC_FIELDS];
+};
+
+// Public methods/ functions
+int  CITIROC_asicFindField(const char* name);
+void CITIROC_asicSetField(CITIROC_asicImage* image, const int field, const int index, const int value);
+int  CITIROC_asicUpdateField(CITIROC_asicImage* image, const int field, const std::vector<int>& values);
+int  CITIROC_asicUpdate(CITIROC_asicImage* image, const std::vector<int>* values);
+int  CITIROC_asicGetBit(const CITIROC_asicImage* image, const int position);
+void CITIROC_asicPrint(const CITIROC_asicImage* image);
+#endif
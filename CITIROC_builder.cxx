@@ -0,0 +1,117 @@
+/* Event building across the boards of the frontend */
+#include "CITIROC_builder.h"
+#include <limits.h>
+#include <algorithm>
+
+bool CITIROC_builderReset(CITIROC_builder* builder, CITIROC_acquisition* const* boards, const int nbBoards,
+                          const int mode, const long long window, const long long timeout) {
+    /**
+     * Build events from the rings of these boards, and zero the counters.
+     * @param mode: CITIROC_BUILD_*.
+     * @param window: largest key difference within an event, in cycles
+     *                or us; keep it shorter than a cycle in time mode.
+     * @param timeout: how long an event waits for the boards whose
+     *                 ring is empty, us.
+     * @return false if the arguments are out of range.
+     */
+    if (nbBoards < 1 || nbBoards > CITIROC_BUILDER_MAX_BOARDS) return false;
+    if (mode < CITIROC_BUILD_OFF || mode > CITIROC_BUILD_TIME || window < 0 || timeout < 0) return false;
+    *builder = CITIROC_builder();
+    builder->mode     = mode;
+    builder->window   = window;
+    builder->timeout  = timeout;
+    builder->nbBoards = nbBoards;
+    for (int b=0; b<nbBoards; b++) {
+        builder->boards[b] = boards[b];
+        builder->banked[b] = LLONG_MIN;
+    }
+    return true;
+}
+
+static long long CITIROC_builderKey(const CITIROC_builder* builder, const CITIROC_rawCycle* cycle) {
+    return (builder->mode == CITIROC_BUILD_TIME) ? cycle->hostTime : (long long)cycle->cycleNumber;
+}
+
+bool CITIROC_builderNext(CITIROC_builder* builder, const long long now, CITIROC_builtEvent* event) {
+    /**
+     * K-way merge of the oldest cycle queued by each board.
+     * The earliest one and the others within the window make an event.
+     * A board with an empty ring is waited for, up to the timeout,
+     * unless its acquisition is over or a ring of the event is full.
+     * A cycle keyed at or below an event already built without its board,
+     * or at or below the last cycle banked from its board, is returned alone, as late.
+     * @param now: steady clock, us.
+     * @param event: fragments of the event, valid until CITIROC_builderRelease.
+     * @return true if an event is ready.
+     */
+    *event = CITIROC_builtEvent();
+    CITIROC_rawCycle* head[CITIROC_BUILDER_MAX_BOARDS] = {};
+    long long key[CITIROC_BUILDER_MAX_BOARDS] = {};
+    int earliest = -1;
+    for (int b=0; b<builder->nbBoards; b++) {
+        head[b] = CITIROC_nextCycle(builder->boards[b]);
+        if (head[b] == NULL) continue;
+        key[b] = CITIROC_builderKey(builder, head[b]);
+        if (earliest < 0 || key[b] < key[earliest]) earliest = b;
+    }
+    if (earliest < 0) return false;
+    const uint32_t allBoards = (1u << builder->nbBoards) - 1;
+
+    for (int b=0; b<builder->nbBoards && builder->mode != CITIROC_BUILD_OFF; b++) {
+        if (head[b] == NULL || key[b] > builder->banked[b]) continue;
+        event->key  = key[b];
+        event->mask = 1u << b;
+        event->late = true;
+        event->fragment[b] = head[b];
+        builder->late++;
+        builder->events++;
+        return true;
+    }
+
+    uint32_t mask = 0;
+    for (int b=0; b<builder->nbBoards; b++) {
+        if (head[b] == NULL) continue;
+        if (builder->mode == CITIROC_BUILD_OFF || key[b] - key[earliest] <= builder->window) mask |= 1u << b;
+    }
+
+    if (builder->mode != CITIROC_BUILD_OFF && mask != allBoards) {
+        // Boards with a later cycle queued have nothing for this event
+        bool wait = false, stalled = false;
+        for (int b=0; b<builder->nbBoards; b++) {
+            const CITIROC_acquisition* acquisition = builder->boards[b];
+            if ((mask >> b) & 1) {stalled |= acquisition->ring.full(); continue;}
+            if (head[b] == NULL && acquisition->running && !acquisition->finished) wait = true;
+        }
+        if (wait && !stalled) {
+            if (builder->pendingSince < 0 || builder->pendingKey != key[earliest]) {
+                builder->pendingKey   = key[earliest];
+                builder->pendingSince = now;
+            }
+            if (now - builder->pendingSince < builder->timeout) return false;
+            builder->timeouts++;
+        }
+    }
+
+    event->key  = key[earliest];
+    event->mask = mask;
+    for (int b=0; b<builder->nbBoards; b++) {
+        if ((mask >> b) & 1) event->fragment[b] = head[b];
+    }
+    if (mask == allBoards) builder->complete++;
+    else builder->orphans += __builtin_popcount(mask);
+    builder->events++;
+    for (int b=0; b<builder->nbBoards; b++) {
+        builder->banked[b] = ((mask >> b) & 1) ? key[b] : std::max(builder->banked[b], key[earliest]);
+    }
+    builder->pendingSince = -1;
+    return true;
+}
+
+void CITIROC_builderRelease(CITIROC_builder* builder, const CITIROC_builtEvent* event) {
+    /**
+     * Hand the fragments of an event back to the acquisition threads.
+     */
+    for (int b=0; b<builder->nbBoards; b++) {
+        if ((event->mask >> b) & 1) CITIROC_releaseCycle(builder->boards[b]);
+    }
+}
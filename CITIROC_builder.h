@@ -0,0 +1,52 @@
+#ifndef CITIROC_BUILDER_H
+#define CITIROC_BUILDER_H
+
+#include <stdint.h>
+#include "CITIROC_acquisition.h"
+
+#define CITIROC_BUILDER_MAX_BOARDS 8
+
+// How cycles of different boards are matched, see CITIROC_builderNext.
+#define CITIROC_BUILD_OFF   0  // next cycle of every board that has one
+#define CITIROC_BUILD_CYCLE 1  // same cycle number, within window cycles
+#define CITIROC_BUILD_TIME  2  // readout end (hostTime) within window us
+
+// Merges the cycles queued by the acquisition threads of several boards
+// into events. The fragments stay in the rings of the boards until
+// CITIROC_builderRelease, so the buffering is bounded by the ring sizes.
+// Used by the frontend thread only.
+struct CITIROC_builder {
+    int       mode    = CITIROC_BUILD_OFF;
+    long long window  = 0;       // cycles or us
+    long long timeout = 100000;  // longest wait for a missing fragment, us
+    int       nbBoards = 0;
+    CITIROC_acquisition* boards[CITIROC_BUILDER_MAX_BOARDS] = {};
+
+    // Per board, highest key an event built has taken from it or gone past
+    // without it; a cycle of that board at or below it is late.
+    long long banked[CITIROC_BUILDER_MAX_BOARDS] = {};
+    long long pendingKey = 0;    // earliest key waiting for fragments
+    long long pendingSince = -1; // when it started waiting, us
+
+    // Counters, since CITIROC_builderReset
+    uint64_t events     = 0;
+    uint64_t complete   = 0;     // events with a fragment of every board
+    uint64_t orphans    = 0;     // fragments built without the other boards
+    uint64_t late       = 0;     // fragments arriving after their event was built
+    uint64_t timeouts   = 0;     // events built after waiting for timeout
+};
+
+// One event: a fragment per board in mask, NULL for the others.
+struct CITIROC_builtEvent {
+    long long key  = 0;          // cycle number or hostTime of the earliest fragment
+    uint32_t  mask = 0;          // bit b set if board b has a fragment
+    bool      late = false;      // a lone fragment of an event already built
+    CITIROC_rawCycle* fragment[CITIROC_BUILDER_MAX_BOARDS] = {};
+};
+
+// Public methods/ functions
+bool CITIROC_builderReset(CITIROC_builder* builder, CITIROC_acquisition* const* boards, const int nbBoards,
+                          const int mode, const long long window, const long long timeout);
+bool CITIROC_builderNext(CITIROC_builder* builder, const long long now, CITIROC_builtEvent* event);
+void CITIROC_builderRelease(CITIROC_builder* builder, const CITIROC_builtEvent* event);
+#endif
@@ -0,0 +1,210 @@
+/* Lossless compression of raw FIFO cycles */
+#include "CITIROC_compress.h"
+#include "CITIROC_decoder.h"
+#include "CITIROC_registers.h"
+#include <string.h>
+#include <zlib.h>
+
+// Bit stream, least significant bit first.
+struct CITIROC_bitWriter {
+    std::vector<unsigned char>* out;
+    uint64_t accumulator = 0;
+    int      nbBits      = 0;
+
+    void put(const uint32_t value, const int width) {
+        accumulator |= (uint64_t)value << nbBits;
+        nbBits += width;
+        while (nbBits >= 8) {
+            out->push_back(accumulator & 0xFF);
+            accumulator >>= 8;
+            nbBits -= 8;
+        }
+    }
+    void flush() {
+        if (nbBits > 0) out->push_back(accumulator & 0xFF);
+        accumulator = 0;
+        nbBits = 0;
+    }
+};
+
+struct CITIROC_bitReader {
+    const unsigned char* in;
+    const unsigned char* end;
+    uint64_t accumulator = 0;
+    int      nbBits      = 0;
+
+    bool get(uint32_t* value, const int width) {
+        while (nbBits < width) {
+            if (in == end) return false;
+            accumulator |= (uint64_t)(*in++) << nbBits;
+            nbBits += 8;
+        }
+        *value = accumulator & ((1ULL << width) - 1);
+        accumulator >>= width;
+        nbBits -= width;
+        return true;
+    }
+};
+
+// Deltas that do not fit in the block width are escaped with the all-ones
+// code, followed by the full zigzag value on CITIROC_PACK_ESCAPE_BITS bits.
+#define CITIROC_PACK_ESCAPE_BITS 14
+// Smallest and largest block of one gain: width, no delta or all escaped, flags
+#define CITIROC_PACK_MIN_BITS (4 + CITIROC_WORDS_PER_ACQ * 4)
+#define CITIROC_PACK_MAX_BITS (4 + CITIROC_WORDS_PER_ACQ * (2 * CITIROC_PACK_ESCAPE_BITS + 4))
+
+static int CITIROC_packWidth(const uint32_t* deltas) {
+    /**
+     * Pick the width that minimizes the size of a block,
+     * escapes included (hit channels jump far from the previous sample).
+     * Width 0 has no escape: only a block of zero deltas fits.
+     */
+    int best = 0, bestBits = -1;
+    for (int width=0; width<=CITIROC_PACK_ESCAPE_BITS; width++) {
+        const uint32_t escape = (1u << width) - 1;
+        int bits = CITIROC_WORDS_PER_ACQ * width;
+        for (int chn=0; chn<CITIROC_WORDS_PER_ACQ; chn++) {
+            if (width == 0 && deltas[chn] != 0) bits += 1 << 20;
+            else if (width > 0 && deltas[chn] >= escape) bits += CITIROC_PACK_ESCAPE_BITS;
+        }
+        if (width == 0 && bits == 0) return 0;
+        if (bestBits < 0 || bits < bestBits) {best = width; bestBits = bits;}
+    }
+    return best;
+}
+
+static void CITIROC_packGain(const unsigned char* low, const unsigned char* high, const int nbAcq, CITIROC_bitWriter* writer) {
+    int previous[CITIROC_WORDS_PER_ACQ] = {};
+    uint32_t deltas[CITIROC_WORDS_PER_ACQ];
+    for (int acq=0; acq<nbAcq; acq++) {
+        const int first = acq * CITIROC_WORDS_PER_ACQ;
+        for (int chn=0; chn<CITIROC_WORDS_PER_ACQ; chn++) {
+            const int adc   = (high[first+chn] << 4) | (low[first+chn] >> 4);
+            const int delta = adc - previous[chn];
+            previous[chn] = adc;
+            deltas[chn] = ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31);
+        }
+        const int width = CITIROC_packWidth(deltas);
+        const uint32_t escape = (1u << width) - 1;
+        writer->put(width, 4);
+        if (width > 0) {
+            for (int chn=0; chn<CITIROC_WORDS_PER_ACQ; chn++) {
+                if (deltas[chn] < escape) {writer->put(deltas[chn], width); continue;}
+                writer->put(escape, width);
+                writer->put(deltas[chn], CITIROC_PACK_ESCAPE_BITS);
+            }
+        }
+        for (int chn=0; chn<CITIROC_WORDS_PER_ACQ; chn++) writer->put(low[first+chn] & 0x0F, 4);
+    }
+}
+
+static bool CITIROC_unpackGain(CITIROC_bitReader* reader, const int nbAcq, unsigned char* low, unsigned char* high) {
+    int previous[CITIROC_WORDS_PER_ACQ] = {};
+    for (int acq=0; acq<nbAcq; acq++) {
+        const int first = acq * CITIROC_WORDS_PER_ACQ;
+        uint32_t width, value;
+        if (!reader->get(&width, 4) || width > CITIROC_PACK_ESCAPE_BITS) return false;
+        const uint32_t escape = (1u << width) - 1;
+        for (int chn=0; chn<CITIROC_WORDS_PER_ACQ; chn++) {
+            value = 0;
+            if (width > 0) {
+                if (!reader->get(&value, width)) return false;
+                if (value == escape && !reader->get(&value, CITIROC_PACK_ESCAPE_BITS)) return false;
+            }
+            const int delta = (int)(value >> 1) ^ -(int)(value & 1);
+            previous[chn] += delta;
+            if (previous[chn] < 0 || previous[chn] > 0xFFF) return false;  // not a 12-bit ADC
+            high[first+chn] = (previous[chn] >> 4) & 0xFF;
+            low[first+chn]  = (previous[chn] & 0x0F) << 4;
+        }
+        for (int chn=0; chn<CITIROC_WORDS_PER_ACQ; chn++) {
+            if (!reader->get(&value, 4)) return false;
+            low[first+chn] |= value;
+        }
+    }
+    return true;
+}
+
+int CITIROC_compressCycle(const unsigned char* const* fifo, const int nbAcq, const int codec,
+                          const int level, std::vector<unsigned char>* compressed) {
+    /**
+     * Compress the first nbAcq acquisitions of a raw cycle.
+     * @param fifo: bytes read from subaddresses 20, 21, 23 and 24.
+     * @param level: zlib level, 1 to 9; unused by the other codecs.
+     * @param compressed: header and payload; its memory is reused.
+     * @return size of the compressed cycle, -1 on error.
+     */
+    const int nbBytes = nbAcq * CITIROC_WORDS_PER_ACQ;
+    CITIROC_compressHeader header = {CITIROC_COMPRESS_MAGIC, (uint32_t)codec, (uint32_t)nbAcq, 0, 0};
+    uLong crc = crc32(0L, Z_NULL, 0);
+    for (int k=0; k<4; k++) crc = crc32(crc, fifo[k], nbBytes);
+    header.crc = crc;
+
+    compressed->resize(sizeof(header));
+    if (codec == CITIROC_CODEC_PACK) {
+        CITIROC_bitWriter writer;
+        writer.out = compressed;
+        CITIROC_packGain(fifo[0], fifo[1], nbAcq, &writer);
+        CITIROC_packGain(fifo[2], fifo[3], nbAcq, &writer);
+        writer.flush();
+    } else if (codec == CITIROC_CODEC_ZLIB) {
+        static thread_local std::vector<unsigned char> raw;
+        raw.resize(4 * nbBytes);
+        for (int k=0; k<4; k++) memcpy(raw.data() + k*nbBytes, fifo[k], nbBytes);
+        uLongf nbPayload = compressBound(raw.size());
+        compressed->resize(sizeof(header) + nbPayload);
+        if (compress2(compressed->data() + sizeof(header), &nbPayload, raw.data(), raw.size(), level) != Z_OK) return -1;
+        compressed->resize(sizeof(header) + nbPayload);
+    } else {
+        return -1;
+    }
+
+    header.nbPayload = compressed->size() - sizeof(header);
+    memcpy(compressed->data(), &header, sizeof(header));
+    return compressed->size();
+}
+
+int CITIROC_decompressCycle(const unsigned char* compressed, const int nbCompressed,
+                            std::vector<unsigned char>* fifo) {
+    /**
+     * Restore the raw FIFO bytes of a cycle compressed by CITIROC_compressCycle
+     * and check them against the CRC-32 of the header.
+     * @param fifo: four vectors, resized to the acquisitions of the cycle.
+     * @return number of acquisitions, -1 if the cycle is corrupted:
+     *         bad magic or codec, more acquisitions than a cycle holds,
+     *         payload size out of the range of the codec, ADC out of 12 bits,
+     *         bytes left after the payload, or CRC mismatch.
+     */
+    CITIROC_compressHeader header;
+    if (nbCompressed < (int)sizeof(header)) return -1;
+    memcpy(&header, compressed, sizeof(header));
+    if (header.magic != CITIROC_COMPRESS_MAGIC || header.nbPayload > nbCompressed - sizeof(header)) return -1;
+    if (header.nbAcq < 1 || header.nbAcq > (uint32_t)CITIROC_MAX_ACQ_IN_CYCLE) return -1;
+    const unsigned char* payload = compressed + sizeof(header);
+    const int nbBytes = header.nbAcq * CITIROC_WORDS_PER_ACQ;
+
+    if (header.codec == CITIROC_CODEC_PACK) {
+        const uint64_t nbBits = 8ULL * header.nbPayload;
+        if (nbBits < 2ULL * header.nbAcq * CITIROC_PACK_MIN_BITS || nbBits > 2ULL * header.nbAcq * CITIROC_PACK_MAX_BITS + 7) return -1;
+        for (int k=0; k<4; k++) fifo[k].resize(nbBytes);
+        CITIROC_bitReader reader = {payload, payload + header.nbPayload};
+        if (!CITIROC_unpackGain(&reader, header.nbAcq, fifo[0].data(), fifo[1].data())) return -1;
+        if (!CITIROC_unpackGain(&reader, header.nbAcq, fifo[2].data(), fifo[3].data())) return -1;
+        if (reader.in != reader.end) return -1;  // bytes left after the last block
+    } else if (header.codec == CITIROC_CODEC_ZLIB) {
+        if (header.nbPayload < 1 || header.nbPayload > compressBound(4 * nbBytes)) return -1;
+        for (int k=0; k<4; k++) fifo[k].resize(nbBytes);
+        std::vector<unsigned char> raw(4 * nbBytes);
+        uLongf nbRaw = raw.size();
+        uLong  nbUsed = header.nbPayload;
+        if (uncompress2(raw.data(), &nbRaw, payload, &nbUsed) != Z_OK || nbRaw != raw.size()) return -1;
+        if (nbUsed != header.nbPayload) return -1;  // bytes left after the deflate stream
+        for (int k=0; k<4; k++) memcpy(fifo[k].data(), raw.data() + k*nbBytes, nbBytes);
+    } else {
+        return -1;
+    }
+
+    uLong crc = crc32(0L, Z_NULL, 0);
+    for (int k=0; k<4; k++) crc = crc32(crc, fifo[k].data(), nbBytes);
+    return (crc == header.crc) ? (int)header.nbAcq : -1;
+}
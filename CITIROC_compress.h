@@ -0,0 +1,38 @@
+#ifndef CITIROC_COMPRESS_H
+#define CITIROC_COMPRESS_H
+
+#include <stdint.h>
+#include <vector>
+
+// Lossless codecs for the raw FIFO bytes of a cycle.
+#define CITIROC_CODEC_NONE 0
+#define CITIROC_CODEC_PACK 1  // delta + bit packing of the 12-bit ADC fields
+#define CITIROC_CODEC_ZLIB 2  // deflate of the four FIFOs
+
+// A compressed cycle starts with this header, in host byte order,
+// followed by nbPayload bytes. crc is the CRC-32 of the raw bytes
+// of FIFOs 20, 21, 23 and 24, in this order.
+#define CITIROC_COMPRESS_MAGIC 0x5A433143 // "C1CZ"
+struct CITIROC_compressHeader {
+    uint32_t magic;
+    uint32_t codec;
+    uint32_t nbAcq;
+    uint32_t nbPayload;
+    uint32_t crc;
+};
+
+// PACK payload, for the HG words (fifo21 << 8 | fifo20), then the LG words
+// (fifo24 << 8 | fifo23), one block per acquisition:
+//   4 bits:       width w of the ADC deltas
+//   33 x w bits:  zigzag(ADC - ADC of the same channel in the previous acquisition);
+//                 the all-ones code escapes a value that does not fit,
+//                 written next on 14 bits. Nothing when w = 0.
+//   33 x 4 bits:  flag bits 0..3 of the words
+// Bits are written least significant first.
+
+// Public methods/ functions
+int CITIROC_compressCycle(const unsigned char* const* fifo, const int nbAcq, const int codec,
+                          const int level, std::vector<unsigned char>* compressed);
+int CITIROC_decompressCycle(const unsigned char* compressed, const int nbCompressed,
+                            std::vector<unsigned char>* fifo);
+#endif
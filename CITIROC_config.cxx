@@ -0,0 +1,128 @@
+/* Cached ODB settings, refreshed by ODB hotlinks */
+#include "CITIROC.h"
+#include "CITIROC_config.h"
+
+static std::shared_ptr<const CITIROC_config> CITIROC_currentConfig;
+
+std::shared_ptr<const CITIROC_config> CITIROC_getConfig() {
+    /**
+     * Current configuration snapshot.
+     * Loaded from ODB on first use if CITIROC_loadConfig was never called;
+     * afterwards this never touches ODB.
+     * Keep the returned pointer for as long as a consistent view is needed.
+     * @return the snapshot, never NULL.
+     */
+    std::shared_ptr<const CITIROC_config> config = std::atomic_load(&CITIROC_currentConfig);
+    if (config) return config;
+    CITIROC_loadConfig();
+    return std::atomic_load(&CITIROC_currentConfig);
+}
+
+bool CITIROC_loadConfig() {
+    /**
+     * Read the Firmware, ASIC_values, HV and DAQ directories at ODB
+     * into a new snapshot and publish it.
+     * @return true always.
+     */
+    static uint64_t generation = 0;
+    std::shared_ptr<CITIROC_config> config = std::make_shared<CITIROC_config>();
+
+    midas::odb firmware(odbdir_firmware);
+    for (int i=0; i<CITIROC_NB_FIRMWARE_FIELDS; i++) {
+        config->firmware[i] = (int)firmware[CITIROC_firmwareFields[i].name];
+    }
+    config->timeAcquisitionMode = (bool)firmware["timeAcquisitionMode"];
+
+    midas::odb asic_values(odbdir_asic_values);
+    for (int i=0; i<CITIROC_NB_ASIC_FIELDS; i++) {
+        config->asic[i] = (std::vector<int>)asic_values[CITIROC_asicFields[i].name];
+    }
+
+    midas::odb hv_parameters(odbdir_HV);
+    config->hvDAC.resize(CITIROC_NB_CHANNELS);
+    for (int i=0; i<CITIROC_NB_CHANNELS; i++) {
+        char name[16];
+        sprintf(name, "DAC %02d", i);
+        config->hvDAC[i] = (int)hv_parameters[name];
+    }
+
+    midas::odb daq_parameters(odbdir_DAQ);
+    std::vector<std::string> serialNumbers = (std::vector<std::string>)daq_parameters["Board serial numbers"];
+    for (const std::string& serialNumber: serialNumbers) {
+        if (!serialNumber.empty()) config->serialNumbers.push_back(serialNumber);
+    }
+    config->buildMode     = (int)daq_parameters["Event building (0 off, 1 cycle number, 2 host time)"];
+    config->buildWindow   = (int)daq_parameters["Event-building window (cycles or us)"];
+    config->buildTimeout  = (int)daq_parameters["Event-building timeout (ms)"];
+    config->polling.mode          = (int)daq_parameters["Polling (0 blocking read, 1 adaptive)"];
+    config->polling.sleepFraction = (double)daq_parameters["Polling sleep fraction"];
+    config->polling.spinPolls     = (int)daq_parameters["Polling spin polls"];
+    config->polling.yieldPolls    = (int)daq_parameters["Polling yield polls"];
+    config->polling.sleepUs       = (int)daq_parameters["Polling sleep (us)"];
+    config->freeRunning   = (bool)daq_parameters["Free running"];
+    config->fifoWriteSize = (int)daq_parameters["FIFO write size"];
+    config->fifoReadSize  = (int)daq_parameters["FIFO read size"];
+    config->writeTimeout  = (int)daq_parameters["Write time out (1-255 ms)"];
+    config->readTimeout   = (int)daq_parameters["Read time out (1-255 ms)"];
+    config->nbAcqInCycle  = (int)daq_parameters["Acquisitions per cycle"];
+    config->nbAcq         = (int)daq_parameters["Acquisitions per run"];
+    config->nbChannels    = (int)daq_parameters["Channels"];
+    config->maxFIFODepth  = (bool)daq_parameters["Max FIFO depth"];
+    config->auditPeriod   = (int)daq_parameters["Register audit period (s)"];
+    config->sideFormat    = (int)daq_parameters["Side-channel format (0 off, 1 binary, 2 CSV)"];
+    config->sideDirectory = (std::string)daq_parameters["Side-channel directory"];
+    config->sideQueue     = (int)daq_parameters["Side-channel queue (cycles)"];
+    config->histograms    = (bool)daq_parameters["Online histograms"];
+    config->zeroSuppression = (bool)daq_parameters["Zero suppression"];
+    config->zeroSuppressionThresholds = (std::vector<int>)daq_parameters["Zero-suppression HG thresholds"];
+    config->zeroSuppressionThresholds.resize(CITIROC_NB_CHANNELS, 0);
+    config->zeroSuppressionSigmas = (double)daq_parameters["Zero-suppression pedestal sigmas"];
+    config->pedestalTracking      = (bool)daq_parameters["Pedestal tracking"];
+    config->pedestalSubtraction   = (bool)daq_parameters["Pedestal subtraction"];
+    config->compressionCodec      = (int)daq_parameters["Compression codec (0 off, 1 pack, 2 zlib)"];
+    config->compressionLevel      = (int)daq_parameters["Compression level (zlib 1-9)"];
+    config->scanParameter = (std::string)daq_parameters["Scan parameter"];
+    config->scanChannel   = (int)daq_parameters["Scan channel (-1 all)"];
+    config->scanStart     = (int)daq_parameters["Scan start"];
+    config->scanStop      = (int)daq_parameters["Scan stop"];
+    config->scanStep      = (int)daq_parameters["Scan step"];
+    config->scanAcqPerPoint = (int)daq_parameters["Scan acquisitions per point"];
+    config->useEmulator   = (bool)daq_parameters["Use emulator"];
+    config->emulator.triggerRate        = (double)daq_parameters["Emulator trigger rate (Hz)"];
+    config->emulator.hitProbability     = (double)daq_parameters["Emulator hit probability"];
+    config->emulator.usbLatency         = (int)daq_parameters["Emulator USB latency (us)"];
+    config->emulator.restartProbability = (double)daq_parameters["Emulator restart probability"];
+
+    config->generation = ++generation;
+    std::atomic_store(&CITIROC_currentConfig, std::shared_ptr<const CITIROC_config>(config));
+    if (CITIROC_DEBUG_FLAG) {printf("CITIROC: Configuration snapshot %llu loaded from ODB\n", (unsigned long long)config->generation);}
+    return true;
+}
+
+bool CITIROC_watchConfig(void (*onChange)()) {
+    /**
+     * Reload the snapshot whenever a key changes in the
+     * Firmware, ASIC_values, HV or DAQ directories at ODB.
+     * Hotlinks are served by cm_yield, from the frontend main loop.
+     * Call once, after the directories exist at ODB.
+     * @param onChange: called after each reload, may be NULL.
+     * @return true always.
+     */
+    static void (*callback)() = NULL;
+    static midas::odb watchFirmware(odbdir_firmware);
+    static midas::odb watchASIC(odbdir_asic_values);
+    static midas::odb watchHV(odbdir_HV);
+    static midas::odb watchDAQ(odbdir_DAQ);
+
+    callback = onChange;
+    auto reload = [](midas::odb& changed) {
+        printf("CITIROC: %s changed at ODB, reloading configuration\n", changed.get_full_path().c_str());
+        CITIROC_loadConfig();
+        if (callback != NULL) callback();
+    };
+    watchFirmware.watch(reload);
+    watchASIC.watch(reload);
+    watchHV.watch(reload);
+    watchDAQ.watch(reload);
+    return true;
+}
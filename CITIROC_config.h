@@ -0,0 +1,88 @@
+#ifndef CITIROC_CONFIG_H
+#define CITIROC_CONFIG_H
+
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "CITIROC_asic.h"
+#include "CITIROC_emulator.h"
+#include "CITIROC_poller.h"
+#include "CITIROC_registers.h"
+
+// Copy of the ODB settings used by the API and the frontend.
+// A snapshot is never modified once published: CITIROC_loadConfig
+// builds a new one and swaps it in, so readers holding the previous
+// snapshot keep a consistent view and never touch ODB.
+// Defaults match the values created at ODB by fecitiroc.cxx.
+struct CITIROC_config {
+    uint64_t generation = 0;  // incremented at each load
+
+    // Firmware: values of CITIROC_firmwareFields, in the same order
+    int  firmware[CITIROC_NB_FIRMWARE_FIELDS] = {};
+    bool timeAcquisitionMode = true;
+
+    // ASIC_values, indexed as CITIROC_asicFields
+    std::vector<int> asic[CITIROC_NB_ASIC_FIELDS];
+
+    // HV: "DAC 00" to "DAC 31"; no board path writes them yet
+    std::vector<int> hvDAC;
+
+    // DAQ: boards read by the frontend, one acquisition thread each;
+    // empty entries are skipped
+    std::vector<std::string> serialNumbers;
+
+    // DAQ: event building across boards, see CITIROC_builderReset
+    int  buildMode     = 0;     // CITIROC_BUILD_*
+    int  buildWindow   = 0;     // cycles or us
+    int  buildTimeout  = 100;   // ms
+
+    // DAQ: wait for the end of each cycle, see CITIROC_pollCycleDone
+    CITIROC_pollerConfig polling;
+    bool freeRunning   = false; // arm the next cycle as soon as one is queued
+
+    // DAQ: USB link
+    int  fifoWriteSize = 8192;
+    int  fifoReadSize  = 32768;
+    int  writeTimeout  = 200;   // ms
+    int  readTimeout   = 200;   // ms
+
+    // DAQ: geometry, checked by CITIROC_getGeometry
+    int  nbAcqInCycle  = 100;
+    int  nbAcq         = 0;
+    int  nbChannels    = 32;
+    bool maxFIFODepth  = false;
+
+    // DAQ: monitoring and side channel
+    int  auditPeriod   = 60;    // s, 0: never
+    int  sideFormat    = 0;     // CITIROC_WRITER_*
+    std::string sideDirectory = "~/online";
+    int  sideQueue     = 64;    // cycles
+
+    bool histograms    = true;  // online spectra, see CITIROC_histograms
+    bool zeroSuppression = false;  // C1ZS bank instead of C1HG, C1LG, C1HT
+    std::vector<int> zeroSuppressionThresholds;  // HG, per channel, 0: hit bit only
+    double zeroSuppressionSigmas = 0.;  // HG pedestal sigmas above the pedestal, 0: fixed thresholds only
+    bool pedestalTracking    = true;   // see CITIROC_pedestals
+    bool pedestalSubtraction = false;  // C1HG, C1LG as signed values
+    int  compressionCodec = 0;  // CITIROC_CODEC_*, C1CZ bank instead of C1HG, C1LG, C1HT
+    int  compressionLevel = 1;  // zlib, 1 to 9
+
+    // DAQ: scan, see CITIROC_scanConfigure
+    std::string scanParameter;  // ASIC_values key, empty: no scan
+    int  scanChannel   = -1;    // -1: all values of the parameter
+    int  scanStart     = 0;
+    int  scanStop      = 0;
+    int  scanStep      = 1;
+    int  scanAcqPerPoint = 1000;
+
+    // DAQ: emulator
+    bool useEmulator   = false;
+    CITIROC_emulatorConfig emulator;
+};
+
+// Public methods/ functions
+std::shared_ptr<const CITIROC_config> CITIROC_getConfig();
+bool CITIROC_loadConfig();
+bool CITIROC_watchConfig(void (*onChange)());
+#endif
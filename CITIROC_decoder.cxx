@@ -0,0 +1,294 @@
+/* Binary decoder for the CITIROC1A FIFO words */
+#include "CITIROC_decoder.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CITIROC_DECODER_X86
+#include <immintrin.h>
+#endif
+
+static int CITIROC_decoderPath = CITIROC_DECODER_AUTO;
+
+int CITIROC_decodeFIFOScalar(const unsigned char* fifo20, const unsigned char* fifo21,
+                             const unsigned char* fifo23, const unsigned char* fifo24,
+                             const int nbWords, uint16_t* dataHG, uint16_t* dataLG,
+                             uint8_t* hit, uint8_t* otrHG, uint8_t* otrLG) {
+    /**
+     * Decode HG and LG words straight from the bytes read at
+     * subaddresses 20, 21 (HG) and 23, 24 (LG).
+     * Word j belongs to channel j%33 of acquisition j/33.
+     * Gives the same values as the former bit-string decoding
+     * (ADC = first 12 bits of fifo21+fifo20, OTR = bit 12, hit = bit 13),
+     * with the bit string read as a binary number.
+     * @param fifo20, fifo21, fifo23, fifo24: raw FIFO bytes, nbWords each.
+     * @param nbWords: number of 16-bit words to decode.
+     * @param dataHG, dataLG: 12-bit ADC values, nbWords each.
+     *                        One of them may be NULL to decode a single gain.
+     * @param hit, otrHG, otrLG: flags, nbWords each. May be NULL.
+     * @return number of decoded words.
+     */
+    for (int j=0; j<nbWords; j++) {
+        const unsigned int wordHG = ((unsigned int)fifo21[j] << 8) | fifo20[j];
+        const unsigned int wordLG = ((unsigned int)fifo24[j] << 8) | fifo23[j];
+        if (dataHG) dataHG[j] = (uint16_t)((wordHG >> CITIROC_FIFO_ADC_SHIFT) & CITIROC_FIFO_ADC_MASK);
+        if (dataLG) dataLG[j] = (uint16_t)((wordLG >> CITIROC_FIFO_ADC_SHIFT) & CITIROC_FIFO_ADC_MASK);
+        if (hit)   hit[j]   = (uint8_t)((wordHG >> CITIROC_FIFO_HIT_SHIFT) & 1);
+        if (otrHG) otrHG[j] = (uint8_t)((wordHG >> CITIROC_FIFO_OTR_SHIFT) & 1);
+        if (otrLG) otrLG[j] = (uint8_t)((wordLG >> CITIROC_FIFO_OTR_SHIFT) & 1);
+    }
+    return nbWords;
+}
+
+#ifdef CITIROC_DECODER_X86
+static int CITIROC_decodeFIFOSSE2(const unsigned char* fifo20, const unsigned char* fifo21,
+                                  const unsigned char* fifo23, const unsigned char* fifo24,
+                                  const int nbWords, uint16_t* dataHG, uint16_t* dataLG,
+                                  uint8_t* hit, uint8_t* otrHG, uint8_t* otrLG) {
+    /**
+     * SSE2 version of CITIROC_decodeFIFOScalar, 16 words per iteration.
+     * The flags only live in the lower byte (fifo20/fifo23),
+     * so they are extracted byte-wise without widening.
+     */
+    const __m128i mask12 = _mm_set1_epi16(CITIROC_FIFO_ADC_MASK);
+    const __m128i one8   = _mm_set1_epi8(1);
+    int j = 0;
+    for (; j+16 <= nbWords; j+=16) {
+        const __m128i b20 = _mm_loadu_si128((const __m128i*)(fifo20+j));
+        const __m128i b21 = _mm_loadu_si128((const __m128i*)(fifo21+j));
+        const __m128i b23 = _mm_loadu_si128((const __m128i*)(fifo23+j));
+        const __m128i b24 = _mm_loadu_si128((const __m128i*)(fifo24+j));
+
+        // De-interleave: unpacking (low, high) bytes gives the 16-bit words in order.
+        __m128i w;
+        if (dataHG) {
+            w = _mm_unpacklo_epi8(b20, b21);
+            _mm_storeu_si128((__m128i*)(dataHG+j),   _mm_and_si128(_mm_srli_epi16(w, CITIROC_FIFO_ADC_SHIFT), mask12));
+            w = _mm_unpackhi_epi8(b20, b21);
+            _mm_storeu_si128((__m128i*)(dataHG+j+8), _mm_and_si128(_mm_srli_epi16(w, CITIROC_FIFO_ADC_SHIFT), mask12));
+        }
+        if (dataLG) {
+            w = _mm_unpacklo_epi8(b23, b24);
+            _mm_storeu_si128((__m128i*)(dataLG+j),   _mm_and_si128(_mm_srli_epi16(w, CITIROC_FIFO_ADC_SHIFT), mask12));
+            w = _mm_unpackhi_epi8(b23, b24);
+            _mm_storeu_si128((__m128i*)(dataLG+j+8), _mm_and_si128(_mm_srli_epi16(w, CITIROC_FIFO_ADC_SHIFT), mask12));
+        }
+
+        if (hit)   _mm_storeu_si128((__m128i*)(hit+j),   _mm_and_si128(_mm_srli_epi16(b20, CITIROC_FIFO_HIT_SHIFT), one8));
+        if (otrHG) _mm_storeu_si128((__m128i*)(otrHG+j), _mm_and_si128(_mm_srli_epi16(b20, CITIROC_FIFO_OTR_SHIFT), one8));
+        if (otrLG) _mm_storeu_si128((__m128i*)(otrLG+j), _mm_and_si128(_mm_srli_epi16(b23, CITIROC_FIFO_OTR_SHIFT), one8));
+    }
+    CITIROC_decodeFIFOScalar(fifo20+j, fifo21+j, fifo23+j, fifo24+j, nbWords-j,
+                             dataHG ? dataHG+j : NULL, dataLG ? dataLG+j : NULL,
+                             hit ? hit+j : NULL, otrHG ? otrHG+j : NULL, otrLG ? otrLG+j : NULL);
+    return nbWords;
+}
+
+__attribute__((target("avx2")))
+static int CITIROC_decodeFIFOAVX2(const unsigned char* fifo20, const unsigned char* fifo21,
+                                  const unsigned char* fifo23, const unsigned char* fifo24,
+                                  const int nbWords, uint16_t* dataHG, uint16_t* dataLG,
+                                  uint8_t* hit, uint8_t* otrHG, uint8_t* otrLG) {
+    /**
+     * AVX2 version of CITIROC_decodeFIFOScalar, 32 words per iteration.
+     * Bytes are widened with vpmovzxbw, which keeps the words in order
+     * (vpunpck* would interleave within 128-bit lanes).
+     */
+    const __m256i mask12 = _mm256_set1_epi16(CITIROC_FIFO_ADC_MASK);
+    const __m256i one8   = _mm256_set1_epi8(1);
+    int j = 0;
+    for (; j+32 <= nbWords; j+=32) {
+        const __m256i b20 = _mm256_loadu_si256((const __m256i*)(fifo20+j));
+        const __m256i b21 = _mm256_loadu_si256((const __m256i*)(fifo21+j));
+        const __m256i b23 = _mm256_loadu_si256((const __m256i*)(fifo23+j));
+        const __m256i b24 = _mm256_loadu_si256((const __m256i*)(fifo24+j));
+
+        for (int half=0; half<2; half++) {
+            const __m128i lo20 = half ? _mm256_extracti128_si256(b20, 1) : _mm256_castsi256_si128(b20);
+            const __m128i lo21 = half ? _mm256_extracti128_si256(b21, 1) : _mm256_castsi256_si128(b21);
+            const __m128i lo23 = half ? _mm256_extracti128_si256(b23, 1) : _mm256_castsi256_si128(b23);
+            const __m128i lo24 = half ? _mm256_extracti128_si256(b24, 1) : _mm256_castsi256_si128(b24);
+            const __m256i wHG = _mm256_or_si256(_mm256_cvtepu8_epi16(lo20), _mm256_slli_epi16(_mm256_cvtepu8_epi16(lo21), 8));
+            const __m256i wLG = _mm256_or_si256(_mm256_cvtepu8_epi16(lo23), _mm256_slli_epi16(_mm256_cvtepu8_epi16(lo24), 8));
+            if (dataHG) _mm256_storeu_si256((__m256i*)(dataHG+j+16*half), _mm256_and_si256(_mm256_srli_epi16(wHG, CITIROC_FIFO_ADC_SHIFT), mask12));
+            if (dataLG) _mm256_storeu_si256((__m256i*)(dataLG+j+16*half), _mm256_and_si256(_mm256_srli_epi16(wLG, CITIROC_FIFO_ADC_SHIFT), mask12));
+        }
+
+        if (hit)   _mm256_storeu_si256((__m256i*)(hit+j),   _mm256_and_si256(_mm256_srli_epi16(b20, CITIROC_FIFO_HIT_SHIFT), one8));
+        if (otrHG) _mm256_storeu_si256((__m256i*)(otrHG+j), _mm256_and_si256(_mm256_srli_epi16(b20, CITIROC_FIFO_OTR_SHIFT), one8));
+        if (otrLG) _mm256_storeu_si256((__m256i*)(otrLG+j), _mm256_and_si256(_mm256_srli_epi16(b23, CITIROC_FIFO_OTR_SHIFT), one8));
+    }
+    CITIROC_decodeFIFOSSE2(fifo20+j, fifo21+j, fifo23+j, fifo24+j, nbWords-j,
+                           dataHG ? dataHG+j : NULL, dataLG ? dataLG+j : NULL,
+                           hit ? hit+j : NULL, otrHG ? otrHG+j : NULL, otrLG ? otrLG+j : NULL);
+    return nbWords;
+}
+#endif
+
+static uint32_t CITIROC_hitMaskScalar(const unsigned char* fifo20) {
+    uint32_t mask = 0;
+    for (int chn=0; chn<CITIROC_NB_CHANNELS; chn++) {
+        mask |= (uint32_t)((fifo20[chn] >> CITIROC_FIFO_HIT_SHIFT) & 1) << chn;
+    }
+    return mask;
+}
+
+#ifdef CITIROC_DECODER_X86
+static uint32_t CITIROC_hitMaskSSE2(const unsigned char* fifo20) {
+    // Move the hit bit of each byte to its sign bit and gather them.
+    const __m128i lo = _mm_loadu_si128((const __m128i*)(fifo20));
+    const __m128i hi = _mm_loadu_si128((const __m128i*)(fifo20+16));
+    const uint32_t maskLo = _mm_movemask_epi8(_mm_slli_epi16(lo, 7 - CITIROC_FIFO_HIT_SHIFT));
+    const uint32_t maskHi = _mm_movemask_epi8(_mm_slli_epi16(hi, 7 - CITIROC_FIFO_HIT_SHIFT));
+    return maskLo | (maskHi << 16);
+}
+
+__attribute__((target("avx2")))
+static uint32_t CITIROC_hitMaskAVX2(const unsigned char* fifo20) {
+    const __m256i b = _mm256_loadu_si256((const __m256i*)(fifo20));
+    return (uint32_t)_mm256_movemask_epi8(_mm256_slli_epi16(b, 7 - CITIROC_FIFO_HIT_SHIFT));
+}
+#endif
+
+int CITIROC_decodeHits(const unsigned char* fifo20, const int nbAcq, const int nbChannels, uint32_t* hits) {
+    /**
+     * Pack the hit bits of each acquisition in a 32-bit mask,
+     * bit chn for channel chn. The hit bit only lives in the
+     * lower HG byte, so only subaddress 20 is needed.
+     * @param nbChannels: channels kept in the masks, the others are 0.
+     * @param hits: nbAcq masks.
+     * @return nbAcq.
+     */
+    const uint32_t keep = (nbChannels >= 32) ? 0xFFFFFFFFu : ((1u << nbChannels) - 1u);
+    const int path = CITIROC_getDecoderPath();
+    for (int acq=0; acq<nbAcq; acq++) {
+        const unsigned char* bytes = fifo20 + acq*CITIROC_WORDS_PER_ACQ;
+        uint32_t mask;
+        switch (path) {
+#ifdef CITIROC_DECODER_X86
+        case CITIROC_DECODER_AVX2: mask = CITIROC_hitMaskAVX2(bytes); break;
+        case CITIROC_DECODER_SSE2: mask = CITIROC_hitMaskSSE2(bytes); break;
+#endif
+        default:                   mask = CITIROC_hitMaskScalar(bytes); break;
+        }
+        hits[acq] = mask & keep;
+    }
+    return nbAcq;
+}
+
+int CITIROC_decodeChannels(const unsigned char* fifo20, const unsigned char* fifo21,
+                           const unsigned char* fifo23, const unsigned char* fifo24,
+                           const int nbAcq, const int nbChannels,
+                           uint16_t* dataHG, uint16_t* dataLG) {
+    /**
+     * Decode the first nbChannels channels and the temperature sensor
+     * of nbAcq acquisitions, packed with nbChannels+1 words per acquisition
+     * (the temperature last). With 32 channels this is one CITIROC_decodeFIFO call.
+     * @param dataHG, dataLG: nbAcq*(nbChannels+1) words; one of them may be NULL.
+     * @return number of words written per gain.
+     */
+    const int stride = nbChannels + 1;
+    if (nbChannels >= CITIROC_NB_CHANNELS) {
+        return CITIROC_decodeFIFO(fifo20, fifo21, fifo23, fifo24, nbAcq*CITIROC_WORDS_PER_ACQ,
+                                  dataHG, dataLG, NULL, NULL, NULL);
+    }
+    for (int acq=0; acq<nbAcq; acq++) {
+        const int in  = acq*CITIROC_WORDS_PER_ACQ;
+        const int out = acq*stride;
+        const int tmp = in + CITIROC_NB_CHANNELS;
+        CITIROC_decodeFIFO(fifo20+in, fifo21+in, fifo23+in, fifo24+in, nbChannels,
+                           dataHG ? dataHG+out : NULL, dataLG ? dataLG+out : NULL, NULL, NULL, NULL);
+        CITIROC_decodeFIFOScalar(fifo20+tmp, fifo21+tmp, fifo23+tmp, fifo24+tmp, 1,
+                                 dataHG ? dataHG+out+nbChannels : NULL, dataLG ? dataLG+out+nbChannels : NULL,
+                                 NULL, NULL, NULL);
+    }
+    return nbAcq*stride;
+}
+
+bool CITIROC_setDecoderPath(const int path) {
+    /**
+     * Force one decoder implementation, e.g. to compare throughputs.
+     * @param path: one of CITIROC_DECODER_AUTO/SCALAR/SSE2/AVX2.
+     * @return false if the implementation is not available on this CPU.
+     */
+    if (path == CITIROC_DECODER_AUTO || path == CITIROC_DECODER_SCALAR) {
+        CITIROC_decoderPath = path;
+        return true;
+    }
+#ifdef CITIROC_DECODER_X86
+    if (path == CITIROC_DECODER_SSE2 && __builtin_cpu_supports("sse2")) {
+        CITIROC_decoderPath = path;
+        return true;
+    }
+    if (path == CITIROC_DECODER_AVX2 && __builtin_cpu_supports("avx2")) {
+        CITIROC_decoderPath = path;
+        return true;
+    }
+#endif
+    return false;
+}
+
+int CITIROC_getDecoderPath() {
+    /**
+     * @return implementation used by CITIROC_decodeFIFO, never CITIROC_DECODER_AUTO.
+     */
+    if (CITIROC_decoderPath != CITIROC_DECODER_AUTO) return CITIROC_decoderPath;
+#ifdef CITIROC_DECODER_X86
+    if (__builtin_cpu_supports("avx2")) return CITIROC_DECODER_AVX2;
+    if (__builtin_cpu_supports("sse2")) return CITIROC_DECODER_SSE2;
+#endif
+    return CITIROC_DECODER_SCALAR;
+}
+
+int CITIROC_decodeFIFO(const unsigned char* fifo20, const unsigned char* fifo21,
+                       const unsigned char* fifo23, const unsigned char* fifo24,
+                       const int nbWords, uint16_t* dataHG, uint16_t* dataLG,
+                       uint8_t* hit, uint8_t* otrHG, uint8_t* otrLG) {
+    /**
+     * Decode nbWords HG and LG words with the fastest implementation
+     * available, see CITIROC_decodeFIFOScalar for the arguments.
+     */
+    switch (CITIROC_getDecoderPath()) {
+#ifdef CITIROC_DECODER_X86
+    case CITIROC_DECODER_AVX2:
+        return CITIROC_decodeFIFOAVX2(fifo20, fifo21, fifo23, fifo24, nbWords, dataHG, dataLG, hit, otrHG, otrLG);
+    case CITIROC_DECODER_SSE2:
+        return CITIROC_decodeFIFOSSE2(fifo20, fifo21, fifo23, fifo24, nbWords, dataHG, dataLG, hit, otrHG, otrLG);
+#endif
+    default:
+        return CITIROC_decodeFIFOScalar(fifo20, fifo21, fifo23, fifo24, nbWords, dataHG, dataLG, hit, otrHG, otrLG);
+    }
+}
+
+void CITIROC_reserveCycle(CITIROC_cycleData* cycle, const int nbAcqInCycle) {
+    /**
+     * Allocate the buffers of cycle for nbAcqInCycle acquisitions,
+     * so that decoding cycles up to that size does not allocate.
+     */
+    const int nbWords = nbAcqInCycle * CITIROC_WORDS_PER_ACQ;
+    cycle->hg.reserve(nbWords);
+    cycle->lg.reserve(nbWords);
+    cycle->hit.reserve(nbWords);
+    cycle->otrHG.reserve(nbWords);
+    cycle->otrLG.reserve(nbWords);
+}
+
+int CITIROC_decodeCycle(const unsigned char* fifo20, const unsigned char* fifo21,
+                        const unsigned char* fifo23, const unsigned char* fifo24,
+                        const int nbAcqInCycle, CITIROC_cycleData* cycle) {
+    /**
+     * Decode a full cycle of nbAcqInCycle x 33 words into cycle.
+     * Buffers keep their capacity between calls,
+     * so only the first cycle allocates.
+     * @return number of decoded words.
+     */
+    const int nbWords = nbAcqInCycle * CITIROC_WORDS_PER_ACQ;
+    cycle->nbAcq   = nbAcqInCycle;
+    cycle->nbWords = nbWords;
+    cycle->hg.resize(nbWords);
+    cycle->lg.resize(nbWords);
+    cycle->hit.resize(nbWords);
+    cycle->otrHG.resize(nbWords);
+    cycle->otrLG.resize(nbWords);
+    return CITIROC_decodeFIFO(fifo20, fifo21, fifo23, fifo24, nbWords,
+                              cycle->hg.data(), cycle->lg.data(), cycle->hit.data(),
+                              cycle->otrHG.data(), cycle->otrLG.data());
+}
@@ -0,0 +1,63 @@
+#ifndef CITIROC_DECODER_H
+#define CITIROC_DECODER_H
+
+#include <stdint.h>
+#include <vector>
+
+// Each acquisition holds 32 channels + 1 temperature sensor = 33 16-bit words.
+#define CITIROC_NB_CHANNELS   32
+#define CITIROC_WORDS_PER_ACQ 33
+
+// A 16-bit FIFO word is (fifo21 << 8) | fifo20 for HG
+// and (fifo24 << 8) | fifo23 for LG:
+//
+//   bit  0:     Start ADC read out (HG only)
+//   bit  1:     0
+//   bit  2:     Hit (HG only)
+//   bit  3:     ADC OTR
+//   bit  4..15: ADC[12..1]
+#define CITIROC_FIFO_START_SHIFT 0
+#define CITIROC_FIFO_HIT_SHIFT   2
+#define CITIROC_FIFO_OTR_SHIFT   3
+#define CITIROC_FIFO_ADC_SHIFT   4
+#define CITIROC_FIFO_ADC_MASK    0x0FFF
+
+// Decoder implementations, see CITIROC_setDecoderPath.
+#define CITIROC_DECODER_AUTO   0
+#define CITIROC_DECODER_SCALAR 1
+#define CITIROC_DECODER_SSE2   2
+#define CITIROC_DECODER_AVX2   3
+
+// Decoded acquisition cycle as a structure of arrays.
+// Word j belongs to channel j%33 of acquisition j/33.
+struct CITIROC_cycleData {
+    int nbAcq   = 0;
+    int nbWords = 0;
+    std::vector<uint16_t> hg;
+    std::vector<uint16_t> lg;
+    std::vector<uint8_t>  hit;
+    std::vector<uint8_t>  otrHG;
+    std::vector<uint8_t>  otrLG;
+};
+
+// Public methods/ functions
+int  CITIROC_decodeFIFO(const unsigned char* fifo20, const unsigned char* fifo21,
+                        const unsigned char* fifo23, const unsigned char* fifo24,
+                        const int nbWords, uint16_t* dataHG, uint16_t* dataLG,
+                        uint8_t* hit, uint8_t* otrHG, uint8_t* otrLG);
+int  CITIROC_decodeFIFOScalar(const unsigned char* fifo20, const unsigned char* fifo21,
+                              const unsigned char* fifo23, const unsigned char* fifo24,
+                              const int nbWords, uint16_t* dataHG, uint16_t* dataLG,
+                              uint8_t* hit, uint8_t* otrHG, uint8_t* otrLG);
+int  CITIROC_decodeCycle(const unsigned char* fifo20, const unsigned char* fifo21,
+                         const unsigned char* fifo23, const unsigned char* fifo24,
+                         const int nbAcqInCycle, CITIROC_cycleData* cycle);
+int  CITIROC_decodeChannels(const unsigned char* fifo20, const unsigned char* fifo21,
+                            const unsigned char* fifo23, const unsigned char* fifo24,
+                            const int nbAcq, const int nbChannels,
+                            uint16_t* dataHG, uint16_t* dataLG);
+int  CITIROC_decodeHits(const unsigned char* fifo20, const int nbAcq, const int nbChannels, uint32_t* hits);
+void CITIROC_reserveCycle(CITIROC_cycleData* cycle, const int nbAcqInCycle);
+bool CITIROC_setDecoderPath(const int path);
+int  CITIROC_getDecoderPath();
+#endif
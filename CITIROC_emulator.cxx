@@ -0,0 +1,284 @@
+/* Software model of the CITIROC1A FPGA register file */
+#include "CITIROC_emulator.h"
+#include "CITIROC_decoder.h"
+#include "CITIROC_registers.h"
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#define CITIROC_EMULATOR_ASIC_BYTES 143
+
+// Error codes returned by CITIROC_emulatorLastError
+#define CITIROC_EMULATOR_OK          0
+#define CITIROC_EMULATOR_BAD_ID      1
+#define CITIROC_EMULATOR_TIMEOUT     2
+
+struct CITIROC_emulatedBoard {
+    unsigned char registers[64] = {};
+    std::vector<unsigned char> asicShift;    // bytes written at subaddress 10
+    std::vector<unsigned char> asicLoaded;   // configuration held by the ASIC
+    std::vector<unsigned char> fifo[4];      // subaddresses 20, 21, 23, 24
+    size_t fifoPosition[4] = {};
+    bool acquiring = false;
+    std::chrono::steady_clock::time_point cycleEnd;
+    int rtimeout = 200;                      // ms
+    std::mt19937 rng;
+};
+
+static std::mutex CITIROC_emulatorMutex;
+static std::map<int, CITIROC_emulatedBoard> CITIROC_emulatedBoards;
+static CITIROC_emulatorConfig CITIROC_emulatorSettings;
+static int CITIROC_emulatorNextID = 1;
+// Error of the last call, read by CITIROC_emulatorLastError without the mutex
+static std::atomic<int> CITIROC_emulatorError(CITIROC_EMULATOR_OK);
+
+void CITIROC_emulatorConfigure(const CITIROC_emulatorConfig& config) {
+    /**
+     * Change the emulator settings. Boards opened afterwards
+     * are seeded with config.seed; cycles armed afterwards
+     * follow the new rates.
+     */
+    std::lock_guard<std::mutex> lock(CITIROC_emulatorMutex);
+    CITIROC_emulatorSettings = config;
+}
+
+static int CITIROC_emulatorFIFOIndex(const char subAddress) {
+    switch (subAddress) {
+    case 20: return 0;
+    case 21: return 1;
+    case 23: return 2;
+    case 24: return 3;
+    default: return -1;
+    }
+}
+
+static void CITIROC_emulatorFillCycle(CITIROC_emulatedBoard& board, const int nbAcq, const CITIROC_emulatorConfig& config) {
+    /**
+     * Generate nbAcq acquisitions of 33 words with the layout
+     * described in CITIROC_decoder.h.
+     * @param config: copy of the settings taken under CITIROC_emulatorMutex.
+     */
+    std::uniform_real_distribution<double> uniform(0., 1.);
+    std::normal_distribution<double>       noise(0., config.pedestalNoise);
+    std::exponential_distribution<double>  amplitude(1.);
+
+    for (int k=0; k<4; k++) {board.fifo[k].clear(); board.fifoPosition[k] = 0;}
+
+    for (int acq=0; acq<nbAcq; acq++) {
+        for (int chn=0; chn<CITIROC_WORDS_PER_ACQ; chn++) {
+            int hit = 0, adcHG, adcLG;
+            if (chn < CITIROC_NB_CHANNELS) {
+                hit = (uniform(board.rng) < config.hitProbability) ? 1 : 0;
+                const double signal = hit ? amplitude(board.rng) : 0.;
+                adcHG = (int)(config.pedestalHG + noise(board.rng) + signal*config.signalHG);
+                adcLG = (int)(config.pedestalLG + noise(board.rng) + signal*config.signalLG);
+            } else {
+                // Temperature sensor
+                adcHG = adcLG = 0x800;
+            }
+            const int otrHG = (adcHG > CITIROC_FIFO_ADC_MASK) ? 1 : 0;
+            const int otrLG = (adcLG > CITIROC_FIFO_ADC_MASK) ? 1 : 0;
+            if (adcHG < 0) adcHG = 0;
+            if (adcLG < 0) adcLG = 0;
+            if (otrHG) adcHG = CITIROC_FIFO_ADC_MASK;
+            if (otrLG) adcLG = CITIROC_FIFO_ADC_MASK;
+
+            const unsigned int wordHG = (adcHG << CITIROC_FIFO_ADC_SHIFT) | (otrHG << CITIROC_FIFO_OTR_SHIFT)
+                                      | (hit << CITIROC_FIFO_HIT_SHIFT) | ((chn == 0) << CITIROC_FIFO_START_SHIFT);
+            const unsigned int wordLG = (adcLG << CITIROC_FIFO_ADC_SHIFT) | (otrLG << CITIROC_FIFO_OTR_SHIFT);
+            board.fifo[0].push_back(wordHG & 0xFF);
+            board.fifo[1].push_back(wordHG >> 8);
+            board.fifo[2].push_back(wordLG & 0xFF);
+            board.fifo[3].push_back(wordLG >> 8);
+        }
+    }
+}
+
+static void CITIROC_emulatorLatency() {
+    int usbLatency = 0;
+    {
+        std::lock_guard<std::mutex> lock(CITIROC_emulatorMutex);
+        usbLatency = CITIROC_emulatorSettings.usbLatency;
+    }
+    if (usbLatency > 0) std::this_thread::sleep_for(std::chrono::microseconds(usbLatency));
+}
+
+static int CITIROC_emulatorOpen(char* serialNumber) {
+    std::lock_guard<std::mutex> lock(CITIROC_emulatorMutex);
+    const int usbID = CITIROC_emulatorNextID++;
+    CITIROC_emulatedBoards[usbID].rng.seed(CITIROC_emulatorSettings.seed + usbID);
+    printf("EMULATOR: Opened emulated board %s with usb ID %d\n", serialNumber, usbID);
+    return usbID;
+}
+
+static void CITIROC_emulatorClose(int usbID) {
+    std::lock_guard<std::mutex> lock(CITIROC_emulatorMutex);
+    CITIROC_emulatedBoards.erase(usbID);
+}
+
+static bool CITIROC_emulatorKnown(int usbID) {
+    std::lock_guard<std::mutex> lock(CITIROC_emulatorMutex);
+    const bool known = CITIROC_emulatedBoards.count(usbID) > 0;
+    CITIROC_emulatorError = known ? CITIROC_EMULATOR_OK : CITIROC_EMULATOR_BAD_ID;
+    return known;
+}
+
+static bool CITIROC_emulatorInit(int usbID) {return CITIROC_emulatorKnown(usbID);}
+static bool CITIROC_emulatorSetXferSize(int usbID, int rxsize, int txsize) {return CITIROC_emulatorKnown(usbID);}
+
+static bool CITIROC_emulatorReset(int usbID) {
+    std::lock_guard<std::mutex> lock(CITIROC_emulatorMutex);
+    auto it = CITIROC_emulatedBoards.find(usbID);
+    if (it == CITIROC_emulatedBoards.end()) {CITIROC_emulatorError = CITIROC_EMULATOR_BAD_ID; return false;}
+    CITIROC_emulatedBoard& board = it->second;
+    board.acquiring = false;
+    board.asicShift.clear();
+    for (int k=0; k<4; k++) {board.fifo[k].clear(); board.fifoPosition[k] = 0;}
+    CITIROC_emulatorError = CITIROC_EMULATOR_OK;
+    return true;
+}
+
+static bool CITIROC_emulatorSetTimeouts(int usbID, int ttimeout, int rtimeout) {
+    std::lock_guard<std::mutex> lock(CITIROC_emulatorMutex);
+    auto it = CITIROC_emulatedBoards.find(usbID);
+    if (it == CITIROC_emulatedBoards.end()) {CITIROC_emulatorError = CITIROC_EMULATOR_BAD_ID; return false;}
+    it->second.rtimeout = rtimeout;
+    CITIROC_emulatorError = CITIROC_EMULATOR_OK;
+    return true;
+}
+
+static int CITIROC_emulatorWrite(int usbID, char subAddress, void* buffer, int count) {
+    /**
+     * Models the side effects of the registers used by the CITIROC API:
+     *  10: ASIC configuration bytes, latched on a shift pulse (subaddress 1, bit 1).
+     *   0: bit 7 requests the slow-control correlation test,
+     *      whose result is bit 7 of subaddress 4.
+     *  43: bit 7 arms a cycle of (subaddress 45) acquisitions.
+     */
+    CITIROC_emulatorLatency();
+    std::lock_guard<std::mutex> lock(CITIROC_emulatorMutex);
+    const CITIROC_emulatorConfig config = CITIROC_emulatorSettings;
+    auto it = CITIROC_emulatedBoards.find(usbID);
+    if (it == CITIROC_emulatedBoards.end()) {CITIROC_emulatorError = CITIROC_EMULATOR_BAD_ID; return 0;}
+    CITIROC_emulatedBoard& board = it->second;
+    const unsigned char* bytes = (const unsigned char*)buffer;
+    const int sub = subAddress & 0x3F;
+
+    for (int i=0; i<count; i++) {
+        const unsigned char previous = board.registers[sub];
+        board.registers[sub] = bytes[i];
+
+        if (sub == 10) {
+            board.asicShift.push_back(bytes[i]);
+            if (board.asicShift.size() > CITIROC_EMULATOR_ASIC_BYTES) {
+                board.asicShift.erase(board.asicShift.begin());
+            }
+        } else if (sub == 1 && CITIROC_fieldGet(bytes[i], CITIROC_regScShift) && !CITIROC_fieldGet(previous, CITIROC_regScShift)) {
+            if (CITIROC_fieldGet(board.registers[0], CITIROC_regTestQuery)) {
+                const bool match = (board.asicShift == board.asicLoaded);
+                board.registers[4] = CITIROC_fieldSet(board.registers[4], CITIROC_regScCorrelation, match);
+            }
+            board.asicLoaded = board.asicShift;
+            board.asicShift.clear();
+        } else if (sub == 43) {
+            const bool start = CITIROC_fieldGet(bytes[i], CITIROC_regStartDAQ);
+            if (start && !CITIROC_fieldGet(previous, CITIROC_regStartDAQ)) {
+                const int nbAcq = board.registers[45];
+                CITIROC_emulatorFillCycle(board, nbAcq, config);
+                const double rate = config.triggerRate;
+                const double fillTime = (rate > 0.) ? nbAcq / rate : 0.;
+                board.cycleEnd = std::chrono::steady_clock::now()
+                               + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(fillTime));
+                board.acquiring = true;
+            } else if (!start) {
+                board.acquiring = false;
+            }
+        }
+    }
+    CITIROC_emulatorError = CITIROC_EMULATOR_OK;
+    return count;
+}
+
+static int CITIROC_emulatorRead(int usbID, char subAddress, void* buffer, int count) {
+    /**
+     *   4: bit 0 is set once the armed cycle is complete.
+     *  22: non-zero asks for a new cycle, with restartProbability.
+     *  20, 21, 23, 24: FIFO bytes; block until the cycle is complete
+     *      or the read timeout expires.
+     */
+    CITIROC_emulatorLatency();
+    unsigned char* bytes = (unsigned char*)buffer;
+    const int sub = subAddress & 0x3F;
+    const int fifoIndex = CITIROC_emulatorFIFOIndex(sub);
+
+    std::unique_lock<std::mutex> lock(CITIROC_emulatorMutex);
+    auto it = CITIROC_emulatedBoards.find(usbID);
+    if (it == CITIROC_emulatedBoards.end()) {CITIROC_emulatorError = CITIROC_EMULATOR_BAD_ID; return 0;}
+    CITIROC_emulatedBoard* board = &it->second;
+    const bool done = board->acquiring && std::chrono::steady_clock::now() >= board->cycleEnd;
+
+    if (fifoIndex >= 0) {
+        if (board->acquiring && !done) {
+            const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(board->rtimeout);
+            const auto wakeUp   = (board->cycleEnd < deadline) ? board->cycleEnd : deadline;
+            lock.unlock();
+            std::this_thread::sleep_until(wakeUp);
+            lock.lock();
+            it = CITIROC_emulatedBoards.find(usbID);
+            if (it == CITIROC_emulatedBoards.end()) {CITIROC_emulatorError = CITIROC_EMULATOR_BAD_ID; return 0;}
+            board = &it->second;
+            if (std::chrono::steady_clock::now() < board->cycleEnd) {
+                CITIROC_emulatorError = CITIROC_EMULATOR_TIMEOUT;
+                return 0;
+            }
+        }
+        const std::vector<unsigned char>& fifo = board->fifo[fifoIndex];
+        size_t& position = board->fifoPosition[fifoIndex];
+        int nbRead = 0;
+        while (nbRead < count && position < fifo.size()) {bytes[nbRead++] = fifo[position++];}
+        CITIROC_emulatorError = CITIROC_EMULATOR_OK;
+        return nbRead;
+    }
+
+    unsigned char value = board->registers[sub];
+    if (sub == 4) {
+        value = CITIROC_fieldSet(board->registers[4] & CITIROC_fieldMask(CITIROC_regScCorrelation), CITIROC_regCycleDone, done);
+    } else if (sub == 22) {
+        std::uniform_real_distribution<double> uniform(0., 1.);
+        value = (uniform(board->rng) < CITIROC_emulatorSettings.restartProbability) ? 1 : 0;
+    }
+    memset(bytes, value, count);
+    CITIROC_emulatorError = CITIROC_EMULATOR_OK;
+    return count;
+}
+
+static int CITIROC_emulatorLastError() {return CITIROC_emulatorError;}
+
+static void CITIROC_emulatorPerror(int error) {
+    switch (error) {
+    case CITIROC_EMULATOR_OK:      printf("EMULATOR: No error.\n"); break;
+    case CITIROC_EMULATOR_BAD_ID:  printf("EMULATOR: Unknown usb ID.\n"); break;
+    case CITIROC_EMULATOR_TIMEOUT: printf("EMULATOR: Read timeout.\n"); break;
+    default:                       printf("EMULATOR: Error %d.\n", error); break;
+    }
+}
+
+const CITIROC_transport CITIROC_transportEmulator = {
+    "emulator",
+    CITIROC_emulatorOpen,
+    CITIROC_emulatorClose,
+    CITIROC_emulatorInit,
+    CITIROC_emulatorReset,
+    CITIROC_emulatorSetXferSize,
+    CITIROC_emulatorSetTimeouts,
+    CITIROC_emulatorWrite,
+    CITIROC_emulatorRead,
+    CITIROC_emulatorLastError,
+    CITIROC_emulatorPerror,
+};
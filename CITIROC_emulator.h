@@ -0,0 +1,24 @@
+#ifndef CITIROC_EMULATOR_H
+#define CITIROC_EMULATOR_H
+
+#include "CITIROC_transport.h"
+
+// Settings of the software model of the CITIROC1A board.
+// Acquisitions arrive at triggerRate; a cycle of N acquisitions
+// (subaddress 45) is ready N/triggerRate seconds after arming (subaddress 43).
+struct CITIROC_emulatorConfig {
+    double triggerRate        = 1000.; // Hz
+    double hitProbability     = 0.1;   // per channel and acquisition
+    int    pedestalHG         = 800;   // ADC counts
+    int    pedestalLG         = 400;   // ADC counts
+    double pedestalNoise      = 5.;    // ADC counts, RMS
+    double signalHG           = 1500.; // mean amplitude over pedestal, ADC counts
+    double signalLG           = 150.;  // mean amplitude over pedestal, ADC counts
+    int    usbLatency         = 0;     // added to every transfer, us
+    double restartProbability = 0.;    // chance of subaddress 22 asking for a new cycle
+    unsigned int seed         = 1;
+};
+
+// Public methods/ functions
+void CITIROC_emulatorConfigure(const CITIROC_emulatorConfig& config);
+#endif
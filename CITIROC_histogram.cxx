@@ -0,0 +1,42 @@
+/* Online per-channel HG/LG spectra */
+#include "CITIROC_histogram.h"
+#include <algorithm>
+
+void CITIROC_histogramsReset(CITIROC_histograms* histograms, const int nbChannels) {
+    /**
+     * Empty the spectra and counters; sized for nbChannels channels.
+     * The memory is kept when the size does not change.
+     */
+    histograms->nbChannels = nbChannels;
+    histograms->nbAcq      = 0;
+    histograms->hg.assign((size_t)nbChannels * CITIROC_HISTOGRAM_BINS, 0);
+    histograms->lg.assign((size_t)nbChannels * CITIROC_HISTOGRAM_BINS, 0);
+    std::fill(histograms->hits, histograms->hits + CITIROC_NB_CHANNELS, 0);
+}
+
+void CITIROC_histogramsFill(CITIROC_histograms* histograms, const uint16_t* dataHG, const uint16_t* dataLG,
+                            const uint32_t* hits, const int nbAcq, const int nbChannels) {
+    /**
+     * Add a decoded cycle, as written by CITIROC_decodeChannels
+     * (nbChannels channels + temperature sensor per acquisition)
+     * and CITIROC_decodeHits. The temperature sensor is not histogrammed.
+     * Channels beyond the size given to CITIROC_histogramsReset are ignored.
+     */
+    const int stride = nbChannels + 1;
+    const int nbFilled = std::min(nbChannels, histograms->nbChannels);
+    uint32_t* hg = histograms->hg.data();
+    uint32_t* lg = histograms->lg.data();
+
+    for (int acq=0; acq<nbAcq; acq++) {
+        const uint16_t* acqHG = dataHG + acq*stride;
+        const uint16_t* acqLG = dataLG + acq*stride;
+        for (int chn=0; chn<nbFilled; chn++) {
+            hg[chn*CITIROC_HISTOGRAM_BINS + (acqHG[chn] & CITIROC_FIFO_ADC_MASK)]++;
+            lg[chn*CITIROC_HISTOGRAM_BINS + (acqLG[chn] & CITIROC_FIFO_ADC_MASK)]++;
+        }
+        for (uint32_t mask = hits[acq]; mask != 0; mask &= mask - 1) {
+            histograms->hits[__builtin_ctz(mask)]++;
+        }
+    }
+    histograms->nbAcq += nbAcq;
+}
@@ -0,0 +1,26 @@
+#ifndef CITIROC_HISTOGRAM_H
+#define CITIROC_HISTOGRAM_H
+
+#include <stdint.h>
+#include <vector>
+#include "CITIROC_decoder.h"
+
+// One bin per 12-bit ADC code.
+#define CITIROC_HISTOGRAM_BINS 4096
+
+// Per-channel HG and LG spectra and hit counters, filled from decoded cycles.
+// The spectra of all channels are contiguous: bin b of channel n
+// is hg[n*CITIROC_HISTOGRAM_BINS + b].
+struct CITIROC_histograms {
+    int      nbChannels = 0;
+    uint32_t nbAcq      = 0;  // acquisitions filled since the reset
+    std::vector<uint32_t> hg;
+    std::vector<uint32_t> lg;
+    uint32_t hits[CITIROC_NB_CHANNELS] = {};
+};
+
+// Public methods/ functions
+void CITIROC_histogramsReset(CITIROC_histograms* histograms, const int nbChannels);
+void CITIROC_histogramsFill(CITIROC_histograms* histograms, const uint16_t* dataHG, const uint16_t* dataLG,
+                            const uint32_t* hits, const int nbAcq, const int nbChannels);
+#endif
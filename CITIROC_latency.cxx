@@ -0,0 +1,97 @@
+/* Per-stage latency histograms of the readout path */
+#include "CITIROC_latency.h"
+#include <time.h>
+
+static const char* CITIROC_latencyNames[CITIROC_NB_LATENCIES] = {
+    "arm", "fifo20", "fifo21", "fifo23", "fifo24", "queue", "decode", "bank", "total"
+};
+
+uint64_t CITIROC_monotonicNs() {
+    /**
+     * @return CLOCK_MONOTONIC time, ns.
+     */
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static int CITIROC_latencyBucket(const uint64_t ns) {
+    if (ns < 4) return ns;
+    const int msb = 63 - __builtin_clzll(ns);
+    const int bucket = 4 * (msb - 1) + ((ns >> (msb - 2)) & 3);
+    return (bucket < CITIROC_LATENCY_BUCKETS) ? bucket : CITIROC_LATENCY_BUCKETS - 1;
+}
+
+static uint64_t CITIROC_latencyBucketStart(const int bucket) {
+    if (bucket < 4) return bucket;
+    return (uint64_t)(4 + bucket % 4) << (bucket / 4 - 1);
+}
+
+void CITIROC_latenciesReset(CITIROC_latencies* latencies) {
+    /**
+     * Zero all the histograms. Not atomic as a whole:
+     * call it while no thread records.
+     */
+    for (CITIROC_latencyHistogram& histogram: latencies->stage) {
+        histogram.count = 0;
+        histogram.sum   = 0;
+        histogram.max   = 0;
+        for (std::atomic<uint64_t>& bucket: histogram.buckets) bucket = 0;
+    }
+}
+
+void CITIROC_latencyRecord(CITIROC_latencyHistogram* histogram, const uint64_t ns) {
+    histogram->buckets[CITIROC_latencyBucket(ns)].fetch_add(1, std::memory_order_relaxed);
+    histogram->sum.fetch_add(ns, std::memory_order_relaxed);
+    histogram->count.fetch_add(1, std::memory_order_relaxed);
+    uint64_t max = histogram->max.load(std::memory_order_relaxed);
+    while (ns > max && !histogram->max.compare_exchange_weak(max, ns, std::memory_order_relaxed)) {}
+}
+
+void CITIROC_latenciesRecord(CITIROC_latencies* latencies, const uint64_t* stamps, const int first, const int last) {
+    /**
+     * Record the stages between stamps first and last, and the total
+     * once the last stamp is CITIROC_STAMP_BANKED.
+     * @param stamps: CITIROC_NB_STAMPS timestamps, ns.
+     */
+    for (int k=first; k<last; k++) {
+        if (stamps[k+1] >= stamps[k]) CITIROC_latencyRecord(&latencies->stage[k], stamps[k+1] - stamps[k]);
+    }
+    if (last == CITIROC_STAMP_BANKED && stamps[last] >= stamps[CITIROC_STAMP_ARM]) {
+        CITIROC_latencyRecord(&latencies->stage[CITIROC_LATENCY_TOTAL], stamps[last] - stamps[CITIROC_STAMP_ARM]);
+    }
+}
+
+double CITIROC_latencyPercentile(const CITIROC_latencyHistogram& histogram, const double fraction) {
+    /**
+     * @param fraction: 0.5 for the median, 0.99 for the 99th percentile...
+     * @return latency below which this fraction of the entries falls,
+     *         interpolated within its bucket and at most the maximum, ns; 0 if empty.
+     */
+    uint64_t counts[CITIROC_LATENCY_BUCKETS];
+    uint64_t total = 0;
+    for (int k=0; k<CITIROC_LATENCY_BUCKETS; k++) {
+        counts[k] = histogram.buckets[k].load(std::memory_order_relaxed);
+        total += counts[k];
+    }
+    if (total == 0) return 0.;
+
+    const double target = fraction * total;
+    double below = 0.;
+    for (int k=0; k<CITIROC_LATENCY_BUCKETS; k++) {
+        if (counts[k] == 0) continue;
+        if (below + counts[k] >= target) {
+            const double start = CITIROC_latencyBucketStart(k);
+            const double width = (k + 1 < CITIROC_LATENCY_BUCKETS) ? CITIROC_latencyBucketStart(k + 1) - start : start;
+            const double value = start + width * (target - below) / counts[k];
+            const double max   = (double)histogram.max.load(std::memory_order_relaxed);
+            return (value < max) ? value : max;
+        }
+        below += counts[k];
+    }
+    return (double)histogram.max.load(std::memory_order_relaxed);
+}
+
+const char* CITIROC_latencyName(const int stage) {
+    return (stage >= 0 && stage < CITIROC_NB_LATENCIES) ? CITIROC_latencyNames[stage] : "";
+}
@@ -0,0 +1,48 @@
+#ifndef CITIROC_LATENCY_H
+#define CITIROC_LATENCY_H
+
+#include <stdint.h>
+#include <atomic>
+
+// CLOCK_MONOTONIC timestamps taken along the path of a cycle.
+// The acquisition thread takes the first six (CITIROC_armCycle, CITIROC_drainCycle),
+// the frontend the last three.
+#define CITIROC_STAMP_ARM      0  // before the subaddress 45 and 43 writes
+#define CITIROC_STAMP_READY    1  // subaddress 22 read back, FIFOs being filled
+#define CITIROC_STAMP_FIFO20   2  // end of each FIFO read
+#define CITIROC_STAMP_FIFO21   3
+#define CITIROC_STAMP_FIFO23   4
+#define CITIROC_STAMP_FIFO24   5
+#define CITIROC_STAMP_DEQUEUE  6  // taken from the ring by the readout
+#define CITIROC_STAMP_DECODED  7  // ADC values decoded
+#define CITIROC_STAMP_BANKED   8  // last bank of the board closed
+#define CITIROC_NB_STAMPS      9
+
+// Stage k lasts from stamp k to stamp k+1; the last one is the whole path.
+#define CITIROC_NB_LATENCIES   CITIROC_NB_STAMPS
+#define CITIROC_LATENCY_TOTAL  (CITIROC_NB_STAMPS - 1)
+
+// Log-linear buckets: 4 per power of two, up to 2^40 ns (18 min).
+#define CITIROC_LATENCY_BUCKETS 160
+
+// Latency histogram in ns. Any thread may record and read it without locks;
+// the counters are only approximately consistent with each other while recording.
+struct CITIROC_latencyHistogram {
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> sum{0};
+    std::atomic<uint64_t> max{0};
+    std::atomic<uint64_t> buckets[CITIROC_LATENCY_BUCKETS] = {};
+};
+
+struct CITIROC_latencies {
+    CITIROC_latencyHistogram stage[CITIROC_NB_LATENCIES];
+};
+
+// Public methods/ functions
+uint64_t CITIROC_monotonicNs();
+void     CITIROC_latenciesReset(CITIROC_latencies* latencies);
+void     CITIROC_latencyRecord(CITIROC_latencyHistogram* histogram, const uint64_t ns);
+void     CITIROC_latenciesRecord(CITIROC_latencies* latencies, const uint64_t* stamps, const int first, const int last);
+double   CITIROC_latencyPercentile(const CITIROC_latencyHistogram& histogram, const double fraction);
+const char* CITIROC_latencyName(const int stage);
+#endif
@@ -0,0 +1,94 @@
+/* Online pedestal tracking and subtraction */
+#include "CITIROC_pedestal.h"
+#include <math.h>
+
+void CITIROC_pedestalsReset(CITIROC_pedestals* pedestals, const int nbChannels) {
+    /**
+     * Forget all the samples; track nbChannels channels.
+     */
+    pedestals->nbChannels = (nbChannels < CITIROC_NB_CHANNELS) ? nbChannels : CITIROC_NB_CHANNELS;
+    for (int chn=0; chn<CITIROC_NB_CHANNELS; chn++) {
+        pedestals->hg[chn] = CITIROC_runningStat();
+        pedestals->lg[chn] = CITIROC_runningStat();
+    }
+}
+
+static inline void CITIROC_runningStatAdd(CITIROC_runningStat* stat, const double x) {
+    stat->n++;
+    const double delta = x - stat->mean;
+    stat->mean += delta / stat->n;
+    stat->m2   += delta * (x - stat->mean);
+}
+
+void CITIROC_pedestalsUpdate(CITIROC_pedestals* pedestals, const uint16_t* dataHG, const uint16_t* dataLG,
+                             const uint32_t* hits, const int nbAcq, const int nbChannels) {
+    /**
+     * Add the samples of a decoded cycle
+     * (nbChannels channels + temperature sensor per acquisition,
+     * see CITIROC_decodeChannels) whose hit bit is not set.
+     */
+    const int stride = nbChannels + 1;
+    const int nbTracked = (nbChannels < pedestals->nbChannels) ? nbChannels : pedestals->nbChannels;
+    for (int acq=0; acq<nbAcq; acq++) {
+        const uint16_t* acqHG = dataHG + acq*stride;
+        const uint16_t* acqLG = dataLG + acq*stride;
+        for (int chn=0; chn<nbTracked; chn++) {
+            if ((hits[acq] >> chn) & 1) continue;
+            CITIROC_runningStatAdd(&pedestals->hg[chn], acqHG[chn]);
+            CITIROC_runningStatAdd(&pedestals->lg[chn], acqLG[chn]);
+        }
+    }
+}
+
+double CITIROC_pedestalSigma(const CITIROC_runningStat& stat) {
+    /**
+     * @return standard deviation of the samples, 0 with fewer than 2.
+     */
+    return (stat.n > 1) ? sqrt(stat.m2 / (stat.n - 1)) : 0.;
+}
+
+void CITIROC_pedestalsSubtract(const CITIROC_pedestals* pedestals, uint16_t* dataHG, uint16_t* dataLG,
+                               const int nbAcq, const int nbChannels) {
+    /**
+     * Subtract the rounded pedestal of each channel, in place.
+     * The results are signed: read the arrays back as int16_t.
+     * Channels without samples yet and the temperature sensor are left alone.
+     * Either array may be NULL, e.g. to correct one bank at a time.
+     */
+    int16_t offsetHG[CITIROC_NB_CHANNELS] = {};
+    int16_t offsetLG[CITIROC_NB_CHANNELS] = {};
+    const int nbTracked = (nbChannels < pedestals->nbChannels) ? nbChannels : pedestals->nbChannels;
+    for (int chn=0; chn<nbTracked; chn++) {
+        offsetHG[chn] = (int16_t)lround(pedestals->hg[chn].mean);
+        offsetLG[chn] = (int16_t)lround(pedestals->lg[chn].mean);
+    }
+
+    const int stride = nbChannels + 1;
+    for (int acq=0; acq<nbAcq; acq++) {
+        if (dataHG != NULL) {
+            int16_t* acqHG = (int16_t*)(dataHG + acq*stride);
+            for (int chn=0; chn<nbChannels; chn++) acqHG[chn] -= offsetHG[chn];
+        }
+        if (dataLG != NULL) {
+            int16_t* acqLG = (int16_t*)(dataLG + acq*stride);
+            for (int chn=0; chn<nbChannels; chn++) acqLG[chn] -= offsetLG[chn];
+        }
+    }
+}
+
+void CITIROC_pedestalsThresholds(const CITIROC_pedestals* pedestals, const double nbSigmas,
+                                 const int* thresholds, int* effective) {
+    /**
+     * Zero-suppression thresholds following the pedestals:
+     * HG pedestal + nbSigmas standard deviations, or the fixed
+     * threshold if higher. Channels without samples keep the fixed one.
+     * @param thresholds, effective: CITIROC_NB_CHANNELS values.
+     */
+    for (int chn=0; chn<CITIROC_NB_CHANNELS; chn++) {
+        effective[chn] = thresholds[chn];
+        const CITIROC_runningStat& stat = pedestals->hg[chn];
+        if (nbSigmas <= 0. || chn >= pedestals->nbChannels || stat.n < 2) continue;
+        const int threshold = (int)ceil(stat.mean + nbSigmas * CITIROC_pedestalSigma(stat));
+        if (threshold > effective[chn]) effective[chn] = threshold;
+    }
+}
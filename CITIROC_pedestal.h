@@ -0,0 +1,31 @@
+#ifndef CITIROC_PEDESTAL_H
+#define CITIROC_PEDESTAL_H
+
+#include <stdint.h>
+#include "CITIROC_decoder.h"
+
+// Running mean and variance of one channel (Welford's algorithm).
+struct CITIROC_runningStat {
+    uint64_t n    = 0;
+    double   mean = 0.;
+    double   m2   = 0.;  // sum of squared deviations from the mean
+};
+
+// Per-channel HG and LG pedestals, estimated from the samples
+// of each channel without the hit bit.
+struct CITIROC_pedestals {
+    int nbChannels = 0;
+    CITIROC_runningStat hg[CITIROC_NB_CHANNELS];
+    CITIROC_runningStat lg[CITIROC_NB_CHANNELS];
+};
+
+// Public methods/ functions
+void   CITIROC_pedestalsReset(CITIROC_pedestals* pedestals, const int nbChannels);
+void   CITIROC_pedestalsUpdate(CITIROC_pedestals* pedestals, const uint16_t* dataHG, const uint16_t* dataLG,
+                               const uint32_t* hits, const int nbAcq, const int nbChannels);
+double CITIROC_pedestalSigma(const CITIROC_runningStat& stat);
+void   CITIROC_pedestalsSubtract(const CITIROC_pedestals* pedestals, uint16_t* dataHG, uint16_t* dataLG,
+                                 const int nbAcq, const int nbChannels);
+void   CITIROC_pedestalsThresholds(const CITIROC_pedestals* pedestals, const double nbSigmas,
+                                   const int* thresholds, int* effective);
+#endif
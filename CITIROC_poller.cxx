@@ -0,0 +1,95 @@
+/* Adaptive wait for the end of an acquisition cycle */
+#include "CITIROC.h"
+#include "CITIROC_poller.h"
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+void CITIROC_pollerReset(CITIROC_poller* poller, const CITIROC_pollerConfig& config) {
+    /**
+     * Take new settings and forget the fill time learnt so far,
+     * e.g. with a new run. Call it while the acquisition thread is stopped.
+     */
+    poller->config     = config;
+    poller->fillPerAcq = 0.;
+    poller->polls      = 0;
+    poller->overslept  = 0;
+}
+
+int CITIROC_pollCycleDone(const int CITIROC_usbID, CITIROC_poller* poller, const int nbAcq, const uint64_t armTime, uint64_t* doneTime) {
+    /**
+     * Wait for the cycle armed at armTime to complete (subaddress 4, bit 0).
+     * Sleep until sleepFraction of the expected fill time has passed,
+     * then poll with sleeps of half the time left until the expected end.
+     * From there: spinPolls reads back to back, yieldPolls reads with a
+     * yield in between, then reads with a sleep of sleepUs in between,
+     * doubled after each read up to 1/8 of the expected fill time.
+     * The fill time per acquisition is a moving average (1/8 weight)
+     * of the cycles seen complete. A cycle already complete at the first
+     * poll means the sleep was too long, and the average is cut by 1/4.
+     * @param nbAcq: acquisitions armed at subaddress 45.
+     * @param armTime: CITIROC_monotonicNs before arming, ns.
+     * @param doneTime: if not NULL, set when complete to the estimated end of the cycle:
+     *        halfway between the last read seeing it busy and the read seeing it complete,
+     *        or the start of that read if it was the first of the call.
+     * @return 1 if the cycle is complete, 0 if maxWaitMs passed first
+     *         (call again to keep waiting), -1 if subaddress 4 cannot be read.
+     */
+    const CITIROC_pollerConfig& config = poller->config;
+    const uint64_t deadline = CITIROC_monotonicNs() + 1000000ULL * config.maxWaitMs;
+    const double   expected = poller->fillPerAcq.load(std::memory_order_relaxed) * nbAcq;
+
+    // Predictive sleep, once per cycle
+    bool slept = false;
+    const uint64_t wakeUp = armTime + (uint64_t)(config.sleepFraction * expected);
+    uint64_t now = CITIROC_monotonicNs();
+    if (now < wakeUp) {
+        if (wakeUp > deadline) {
+            std::this_thread::sleep_for(std::chrono::nanoseconds(deadline - now));
+            return 0;
+        }
+        std::this_thread::sleep_for(std::chrono::nanoseconds(wakeUp - now));
+        slept = true;
+    }
+
+    const uint64_t expectedEnd = armTime + (uint64_t)expected;
+    const uint64_t minPause = 1000ULL * config.sleepUs;
+    const uint64_t maxPause = (expected > 0.) ? std::max(minPause, (uint64_t)(expected / 8)) : std::max(minPause, (uint64_t)1000000);
+    uint64_t pause = minPause;
+    int nbTight = 0;  // reads since the expected end
+    uint64_t busyTime = 0;  // end of the last read seeing the cycle busy
+    for (int nbPolls = 0; ; nbPolls++) {
+        byte word4 = 0;
+        const uint64_t readTime = CITIROC_monotonicNs();
+        if (CITIROC_usbRead(CITIROC_usbID, 4, &word4, 1) != 1) return -1;
+        poller->polls.fetch_add(1, std::memory_order_relaxed);
+        now = CITIROC_monotonicNs();
+
+        if (CITIROC_fieldGet(word4, CITIROC_regCycleDone)) {
+            if (doneTime) *doneTime = busyTime ? busyTime + (readTime - busyTime) / 2 : readTime;
+            const double fill = poller->fillPerAcq.load(std::memory_order_relaxed);
+            const double sample = (double)(now - armTime) / nbAcq;
+            if (slept && nbPolls == 0) {
+                poller->fillPerAcq.store(0.75 * fill, std::memory_order_relaxed);
+                poller->overslept.fetch_add(1, std::memory_order_relaxed);
+            } else {
+                poller->fillPerAcq.store((fill > 0.) ? fill + (sample - fill) / 8 : sample, std::memory_order_relaxed);
+            }
+            return 1;
+        }
+        busyTime = now;
+        if (now >= deadline) return 0;
+
+        if (now + minPause < expectedEnd) {
+            std::this_thread::sleep_for(std::chrono::nanoseconds(std::min((expectedEnd - now) / 2 + minPause, deadline - now)));
+            continue;
+        }
+        if (nbTight++ < config.spinPolls) continue;
+        if (nbTight <= config.spinPolls + config.yieldPolls) {
+            std::this_thread::yield();
+            continue;
+        }
+        std::this_thread::sleep_for(std::chrono::nanoseconds(std::min(pause, deadline - now)));
+        pause = std::min(2 * pause, maxPause);
+    }
+}
@@ -0,0 +1,33 @@
+#ifndef CITIROC_POLLER_H
+#define CITIROC_POLLER_H
+
+#include <stdint.h>
+#include <atomic>
+
+// How the acquisition thread waits for the end of a cycle.
+#define CITIROC_POLL_BLOCKING 0  // FIFO reads block until the cycle is complete or the read timeout
+#define CITIROC_POLL_ADAPTIVE 1  // sleep most of the expected fill time, then poll subaddress 4
+
+// Settings of the adaptive wait, see CITIROC_pollCycleDone.
+struct CITIROC_pollerConfig {
+    int    mode          = CITIROC_POLL_ADAPTIVE;
+    double sleepFraction = 0.8;  // of the expected fill time slept before the first poll
+    int    spinPolls     = 20;   // from the expected end, status reads back to back,
+    int    yieldPolls    = 50;   // then with a yield between them,
+    int    sleepUs       = 20;   // then with a sleep between them, doubled up to 1/8 of the fill time
+    int    maxWaitMs     = 100;  // return to the caller at least this often
+};
+
+// Fill time of the cycles of one board, learnt by CITIROC_pollCycleDone.
+// Written by the acquisition thread, read by anyone.
+struct CITIROC_poller {
+    CITIROC_pollerConfig config;
+    std::atomic<double>   fillPerAcq{0.};  // ns per acquisition, moving average, 0 until the first cycle
+    std::atomic<uint64_t> polls{0};        // subaddress 4 reads
+    std::atomic<uint64_t> overslept{0};    // cycles already complete at the first poll
+};
+
+// Public methods/ functions
+void CITIROC_pollerReset(CITIROC_poller* poller, const CITIROC_pollerConfig& config);
+int  CITIROC_pollCycleDone(const int CITIROC_usbID, CITIROC_poller* poller, const int nbAcq, const uint64_t armTime, uint64_t* doneTime = NULL);
+#endif
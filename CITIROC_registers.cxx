@@ -0,0 +1,121 @@
+/* Batched accesses to the FPGA subaddresses */
+#include "CITIROC_registers.h"
+#include "CITIROC_transport.h"
+#include <stdio.h>
+#include <chrono>
+
+bool CITIROC_isConfigRegister(const char subAddress) {
+    /**
+     * Registers that only change when the host writes them:
+     * firmware settings (0, 1, 2, 3, 5), acquisitions per cycle (45)
+     * and temperature sensor (62, 63). Status (4), FIFOs (20, 21, 23, 24),
+     * restart flag (22) and arming (43) are always read from the board.
+     */
+    switch (subAddress) {
+    case 0: case 1: case 2: case 3: case 5:
+    case 45: case 62: case 63:
+        return true;
+    default:
+        return false;
+    }
+}
+
+void CITIROC_shadowRecord(CITIROC_shadow* shadow, const char subAddress, const unsigned char* values, const int count) {
+    /**
+     * Note count bytes written on subAddress; the register keeps the last one.
+     */
+    if (shadow == NULL || count <= 0) return;
+    const int sub = subAddress & 0x3F;
+    shadow->value[sub].store(values[count-1]);
+    shadow->written[sub].store(true);
+}
+
+bool CITIROC_shadowGet(const CITIROC_shadow* shadow, const char subAddress, unsigned char* value) {
+    /**
+     * @return true and the shadow byte at value if subAddress was written.
+     */
+    if (shadow == NULL) return false;
+    const int sub = subAddress & 0x3F;
+    if (!shadow->written[sub].load()) return false;
+    *value = shadow->value[sub].load();
+    return true;
+}
+
+void CITIROC_shadowClear(CITIROC_shadow* shadow) {
+    for (int sub=0; sub<CITIROC_NB_SUBADDRESSES; sub++) {
+        shadow->value[sub].store(0);
+        shadow->written[sub].store(false);
+    }
+}
+
+void CITIROC_batchClear(CITIROC_batch* batch, const char* name) {
+    /**
+     * Empty the batch, keeping its buffers for the next use.
+     * @param name: printed with the latency after each submit, NULL for none.
+     */
+    batch->name = name;
+    batch->ops.clear();
+    batch->data.clear();
+    batch->nbWrites = 0;
+    batch->nbReads  = 0;
+}
+
+void CITIROC_batchWriteBytes(CITIROC_batch* batch, const char subAddress, const unsigned char* values, const int count) {
+    /**
+     * Queue count bytes to be written on subAddress.
+     * They join the previous write if it targets the same subaddress.
+     */
+    if (batch->ops.empty() || !batch->ops.back().write || batch->ops.back().subAddress != subAddress) {
+        batch->ops.push_back({true, subAddress, (int)batch->data.size(), 0, NULL});
+    }
+    batch->data.insert(batch->data.end(), values, values + count);
+    batch->ops.back().count += count;
+    batch->nbWrites += count;
+}
+
+void CITIROC_batchWrite(CITIROC_batch* batch, const char subAddress, const unsigned char value) {
+    CITIROC_batchWriteBytes(batch, subAddress, &value, 1);
+}
+
+void CITIROC_batchRead(CITIROC_batch* batch, const char subAddress, unsigned char* value) {
+    /**
+     * Queue a one-byte read of subAddress, stored at value by CITIROC_batchSubmit.
+     */
+    batch->ops.push_back({false, subAddress, 0, 1, value});
+    batch->nbReads++;
+}
+
+bool CITIROC_batchSubmit(const int usbID, CITIROC_batch* batch, CITIROC_shadow* shadow) {
+    /**
+     * Run the queued accesses in order, one USB transfer per operation.
+     * Stops at the first transfer that does not move all its bytes.
+     * @param shadow: records the writes and serves the reads of
+     *                configuration registers, may be NULL.
+     * @return true if all the transfers are complete.
+     */
+    bool status = true;
+    batch->nbTransfers   = 0;
+    batch->nbShadowReads = 0;
+    const auto start = std::chrono::steady_clock::now();
+
+    for (const CITIROC_batchOp& op: batch->ops) {
+        if (!op.write && CITIROC_isConfigRegister(op.subAddress)
+            && CITIROC_shadowGet(shadow, op.subAddress, op.value)) {
+            batch->nbShadowReads++;
+            continue;
+        }
+        int realCount;
+        if (op.write) realCount = CITIROC_usbWrite(usbID, op.subAddress, &batch->data[op.first], op.count);
+        else          realCount = CITIROC_usbRead(usbID, op.subAddress, op.value, op.count);
+        batch->nbTransfers++;
+        if (realCount != op.count) {status = false; break;}
+        if (op.write) CITIROC_shadowRecord(shadow, op.subAddress, &batch->data[op.first], op.count);
+    }
+
+    batch->latency = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    if (batch->name != NULL) {
+        printf("CITIROC: %s: %d bytes written, %d read in %d transfers, %.0f us\n",
+               batch->name, batch->nbWrites, batch->nbReads, batch->nbTransfers, batch->latency);
+    }
+    return status;
+}
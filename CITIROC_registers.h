@@ -0,0 +1,161 @@
+#ifndef CITIROC_REGISTERS_H
+#define CITIROC_REGISTERS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+#define CITIROC_NB_SUBADDRESSES 64
+
+// Bit field of an FPGA register, positions from citiroc_fpga.xls.
+// Firmware fields are named after their key in the ODB Firmware directory.
+struct CITIROC_registerField {
+    const char* name;
+    char    subAddress;
+    uint8_t shift;
+    uint8_t width;
+};
+
+constexpr uint8_t CITIROC_fieldMask(const CITIROC_registerField& field) {
+    return (uint8_t)(((1u << field.width) - 1u) << field.shift);
+}
+
+constexpr uint8_t CITIROC_fieldSet(const uint8_t word, const CITIROC_registerField& field, const unsigned value) {
+    return (uint8_t)((word & ~CITIROC_fieldMask(field)) | ((value << field.shift) & CITIROC_fieldMask(field)));
+}
+
+constexpr unsigned CITIROC_fieldGet(const uint8_t word, const CITIROC_registerField& field) {
+    return (unsigned)(word & CITIROC_fieldMask(field)) >> field.shift;
+}
+
+// Subaddress 0: firmware settings and slow-control test query
+constexpr CITIROC_registerField CITIROC_regSelValEvt          = {"selValEvt",          0, 0, 1};
+constexpr CITIROC_registerField CITIROC_regRazChn             = {"razChn",             0, 1, 1};
+constexpr CITIROC_registerField CITIROC_regValEvt             = {"valEvt",             0, 2, 1};
+constexpr CITIROC_registerField CITIROC_regSelRazChn          = {"selRazChn",          0, 3, 1};
+constexpr CITIROC_registerField CITIROC_regEnSerialLink       = {"enSerialLink",       0, 4, 1};
+constexpr CITIROC_registerField CITIROC_regDisReadAdc         = {"disReadAdc",         0, 5, 1};
+constexpr CITIROC_registerField CITIROC_regTestQuery          = {"testQuery",          0, 7, 1};
+// Subaddress 1: firmware settings and slow-control shift register
+constexpr CITIROC_registerField CITIROC_regScWrite            = {"scWrite",            1, 0, 1};
+constexpr CITIROC_registerField CITIROC_regScShift            = {"scShift",            1, 1, 1};
+constexpr CITIROC_registerField CITIROC_regOR32polarity       = {"OR32polarity",       1, 2, 1};
+constexpr CITIROC_registerField CITIROC_regReadOutSpeed       = {"readOutSpeed",       1, 3, 1};
+constexpr CITIROC_registerField CITIROC_regRstbPa             = {"rstbPa",             1, 4, 1};
+constexpr CITIROC_registerField CITIROC_regSelect             = {"select",             1, 5, 1};
+constexpr CITIROC_registerField CITIROC_regSub1Fixed          = {"fixed",              1, 6, 2};
+// Subaddress 2
+constexpr CITIROC_registerField CITIROC_regADC2               = {"ADC2",               2, 0, 1};
+constexpr CITIROC_registerField CITIROC_regADC1               = {"ADC1",               2, 1, 1};
+constexpr CITIROC_registerField CITIROC_regSub2Fixed          = {"fixed",              2, 2, 1};
+// Subaddress 3
+constexpr CITIROC_registerField CITIROC_regPwrOn              = {"pwrOn",              3, 0, 1};
+constexpr CITIROC_registerField CITIROC_regTriggerTorQ        = {"triggerTorQ",        3, 1, 1};
+constexpr CITIROC_registerField CITIROC_regSelTrigToHold      = {"selTrigToHold",      3, 2, 1};
+constexpr CITIROC_registerField CITIROC_regSelHold            = {"selHold",            3, 3, 1};
+constexpr CITIROC_registerField CITIROC_regTimeOutHold        = {"timeOutHold",        3, 4, 1};
+constexpr CITIROC_registerField CITIROC_regRstbPS             = {"rstbPS",             3, 7, 1};
+// Subaddress 4: status
+constexpr CITIROC_registerField CITIROC_regCycleDone          = {"cycleDone",          4, 0, 1};
+constexpr CITIROC_registerField CITIROC_regScCorrelation      = {"scCorrelation",      4, 7, 1};
+// Subaddress 5
+constexpr CITIROC_registerField CITIROC_regPSMode             = {"PSMode",             5, 0, 1};
+constexpr CITIROC_registerField CITIROC_regPSGlobalTrigger    = {"PSGlobalTrigger",    5, 1, 1};
+constexpr CITIROC_registerField CITIROC_regSelPSMode          = {"selPSMode",          5, 5, 1};
+constexpr CITIROC_registerField CITIROC_regSelPSGlobalTrigger = {"selPSGlobalTrigger", 5, 6, 1};
+// Subaddresses 43, 45: data acquisition
+constexpr CITIROC_registerField CITIROC_regStartDAQ           = {"startDAQ",          43, 7, 1};
+constexpr CITIROC_registerField CITIROC_regNbAcqInCycle       = {"nbAcqInCycle",      45, 0, 8};
+
+// Largest number of acquisitions per cycle held by subaddress 45.
+#define CITIROC_MAX_ACQ_IN_CYCLE ((int)CITIROC_fieldMask(CITIROC_regNbAcqInCycle))
+
+// Firmware words sent by CITIROC_sendFirmwareSettings, see CITIROC_getFirmwareWords.
+#define CITIROC_NB_FIRMWARE_WORDS 5
+constexpr char CITIROC_firmwareSubAddresses[CITIROC_NB_FIRMWARE_WORDS] = {0, 1, 2, 3, 5};
+
+// Bits that are always set in the firmware words.
+constexpr uint8_t CITIROC_firmwareFixedBits[CITIROC_NB_FIRMWARE_WORDS] = {
+    0x00,
+    CITIROC_fieldSet(0, CITIROC_regSub1Fixed, 3),
+    CITIROC_fieldSet(0, CITIROC_regSub2Fixed, 1),
+    0x00,
+    0x00,
+};
+
+// Fields of the firmware words read from ODB.
+constexpr CITIROC_registerField CITIROC_firmwareFields[] = {
+    CITIROC_regSelValEvt, CITIROC_regRazChn, CITIROC_regValEvt, CITIROC_regSelRazChn,
+    CITIROC_regEnSerialLink, CITIROC_regDisReadAdc,
+    CITIROC_regOR32polarity, CITIROC_regReadOutSpeed, CITIROC_regRstbPa, CITIROC_regSelect,
+    CITIROC_regADC2, CITIROC_regADC1,
+    CITIROC_regPwrOn, CITIROC_regTriggerTorQ, CITIROC_regSelTrigToHold, CITIROC_regSelHold,
+    CITIROC_regTimeOutHold, CITIROC_regRstbPS,
+    CITIROC_regPSMode, CITIROC_regPSGlobalTrigger, CITIROC_regSelPSMode, CITIROC_regSelPSGlobalTrigger,
+};
+#define CITIROC_NB_FIRMWARE_FIELDS ((int)(sizeof(CITIROC_firmwareFields)/sizeof(CITIROC_firmwareFields[0])))
+
+constexpr bool CITIROC_firmwareFieldsDisjoint() {
+    // No two firmware fields (or fixed bits) share a bit.
+    for (int k=0; k<CITIROC_NB_FIRMWARE_WORDS; k++) {
+        uint8_t used = CITIROC_firmwareFixedBits[k];
+        for (int i=0; i<CITIROC_NB_FIRMWARE_FIELDS; i++) {
+            const CITIROC_registerField& field = CITIROC_firmwareFields[i];
+            if (field.subAddress != CITIROC_firmwareSubAddresses[k]) continue;
+            if (used & CITIROC_fieldMask(field)) return false;
+            used |= CITIROC_fieldMask(field);
+        }
+    }
+    return true;
+}
+static_assert(CITIROC_firmwareFieldsDisjoint(), "Overlapping firmware fields");
+
+// Words of the arming and status paths, composed at compile time.
+constexpr uint8_t CITIROC_wordStartDAQ = CITIROC_fieldSet(0, CITIROC_regStartDAQ, 1);
+constexpr uint8_t CITIROC_wordStopDAQ  = CITIROC_fieldSet(0, CITIROC_regStartDAQ, 0);
+
+// Bytes last written to each FPGA subaddress by this process.
+// Configuration registers (see CITIROC_isConfigRegister) are read from here
+// instead of the board; CITIROC_auditRegisters compares both.
+struct CITIROC_shadow {
+    std::atomic<unsigned char> value[CITIROC_NB_SUBADDRESSES]   = {};
+    std::atomic<bool>          written[CITIROC_NB_SUBADDRESSES] = {};
+};
+
+// One queued access of a CITIROC_batch.
+// Writes send `count` bytes of CITIROC_batch::data from `first`;
+// reads store one byte at `value`.
+struct CITIROC_batchOp {
+    bool  write;
+    char  subAddress;
+    int   first;
+    int   count;
+    unsigned char* value;
+};
+
+// Register accesses submitted together by CITIROC_batchSubmit.
+// Consecutive writes to the same subaddress are coalesced
+// into a single USB transfer, in the order they were queued.
+struct CITIROC_batch {
+    const char* name = NULL;          // printed after each submit, NULL for silent batches
+    std::vector<CITIROC_batchOp> ops;
+    std::vector<unsigned char>   data;
+    int    nbWrites      = 0;         // bytes queued for writing
+    int    nbReads       = 0;
+    int    nbShadowReads = 0;         // reads served by the shadow in the last submit
+    int    nbTransfers   = 0;         // USB transfers of the last submit
+    double latency       = 0.;        // duration of the last submit, us
+};
+
+// Public methods/ functions
+bool CITIROC_isConfigRegister(const char subAddress);
+void CITIROC_shadowRecord(CITIROC_shadow* shadow, const char subAddress, const unsigned char* values, const int count);
+bool CITIROC_shadowGet(const CITIROC_shadow* shadow, const char subAddress, unsigned char* value);
+void CITIROC_shadowClear(CITIROC_shadow* shadow);
+void CITIROC_batchClear(CITIROC_batch* batch, const char* name);
+void CITIROC_batchWrite(CITIROC_batch* batch, const char subAddress, const unsigned char value);
+void CITIROC_batchWriteBytes(CITIROC_batch* batch, const char subAddress, const unsigned char* values, const int count);
+void CITIROC_batchRead(CITIROC_batch* batch, const char subAddress, unsigned char* value);
+bool CITIROC_batchSubmit(const int usbID, CITIROC_batch* batch, CITIROC_shadow* shadow);
+#endif
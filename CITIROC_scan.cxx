@@ -0,0 +1,98 @@
+/* Threshold and DAC scans (S-curves) run by the acquisition thread */
+#include "CITIROC.h"
+#include "CITIROC_scan.h"
+
+bool CITIROC_scanConfigure(CITIROC_scan* scan, const CITIROC_config& config) {
+    /**
+     * Set up the scan from the Scan keys of the DAQ settings.
+     * An empty "Scan parameter" disables the scan.
+     * @return false if the settings do not describe a valid scan;
+     * the scan is then left inactive.
+     */
+    scan->active = false;
+    if (config.scanParameter.empty()) return true;
+
+    const int field = CITIROC_asicFindField(config.scanParameter.c_str());
+    if (field < 0) {
+        printf("CITIROC: Unknown scan parameter %s\n", config.scanParameter.c_str());
+        return false;
+    }
+    const CITIROC_asicField& f = CITIROC_asicFields[field];
+    const int maxValue = (1 << f.width) - 1;
+    if (config.scanChannel >= f.count || config.scanStep == 0 || config.scanAcqPerPoint < 1
+        || config.scanStart < 0 || config.scanStart > maxValue || config.scanStop < 0 || config.scanStop > maxValue
+        || (config.scanStop - config.scanStart) / config.scanStep < 0) {
+        printf("CITIROC: Invalid scan of %s (channel %d, %d to %d by %d, %d acquisitions per point)\n",
+               f.name, config.scanChannel, config.scanStart, config.scanStop, config.scanStep, config.scanAcqPerPoint);
+        return false;
+    }
+
+    scan->field    = field;
+    scan->channel  = (config.scanChannel < 0) ? -1 : config.scanChannel;
+    scan->start    = config.scanStart;
+    scan->stop     = config.scanStop;
+    scan->step     = config.scanStep;
+    scan->nbAcqPerPoint = config.scanAcqPerPoint;
+    scan->nbPoints = (scan->stop - scan->start) / scan->step + 1;
+    scan->point    = CITIROC_scanPoint();
+    scan->point.value = scan->start;
+    scan->masks.resize(CITIROC_MAX_ACQ_IN_CYCLE);
+    scan->active   = true;
+    printf("CITIROC: Scanning %s[%d] from %d to %d by %d, %d points of %d acquisitions\n",
+           f.name, scan->channel, scan->start, scan->stop, scan->step, scan->nbPoints, scan->nbAcqPerPoint);
+    return true;
+}
+
+bool CITIROC_scanApply(const int CITIROC_usbID, const CITIROC_scan* scan) {
+    /**
+     * Send the value of the current point to the board.
+     * @return true if the board confirmed the ASIC upload.
+     */
+    return CITIROC_sendASICValue(CITIROC_usbID, scan->field, scan->channel, scan->point.value);
+}
+
+int CITIROC_scanRemaining(const CITIROC_scan* scan) {
+    /**
+     * @return acquisitions still to read at the current point,
+     * so that no cycle spans two points.
+     */
+    return scan->nbAcqPerPoint - (int)scan->point.nbAcq;
+}
+
+bool CITIROC_scanCount(CITIROC_scan* scan, const unsigned char* fifo20, const int nbAcq) {
+    /**
+     * Add the hit bits of a cycle to the current point.
+     * @param fifo20: bytes read from subaddress 20.
+     * @return true if the point has all its acquisitions.
+     */
+    const int n = CITIROC_decodeHits(fifo20, nbAcq, CITIROC_NB_CHANNELS, scan->masks.data());
+    for (int acq=0; acq<n; acq++) {
+        for (uint32_t mask = scan->masks[acq]; mask != 0; mask &= mask - 1) {
+            scan->point.hits[__builtin_ctz(mask)]++;
+        }
+    }
+    scan->point.nbAcq += n;
+    return (int)scan->point.nbAcq >= scan->nbAcqPerPoint;
+}
+
+bool CITIROC_scanNext(const int CITIROC_usbID, CITIROC_scan* scan) {
+    /**
+     * Move to the next point and send its value to the board.
+     * After the last point, the ODB configuration is sent back.
+     * @return false once the scan is over.
+     */
+    const int index = scan->point.index + 1;
+    if (index >= scan->nbPoints) {
+        scan->active = false;
+        printf("CITIROC: Scan of %s done, restoring configuration\n", CITIROC_asicFields[scan->field].name);
+        CITIROC_sendConfiguration(CITIROC_usbID);
+        return false;
+    }
+    scan->point = CITIROC_scanPoint();
+    scan->point.index = index;
+    scan->point.value = scan->start + index * scan->step;
+    if (!CITIROC_scanApply(CITIROC_usbID, scan)) {
+        printf("CITIROC: Scan point %d (%s = %d) not confirmed by the board\n", index, CITIROC_asicFields[scan->field].name, scan->point.value);
+    }
+    return true;
+}
@@ -0,0 +1,41 @@
+#ifndef CITIROC_SCAN_H
+#define CITIROC_SCAN_H
+
+#include <stdint.h>
+#include <vector>
+#include "CITIROC_decoder.h"
+
+struct CITIROC_config;
+
+// Hits counted at one point of a scan.
+struct CITIROC_scanPoint {
+    int      index = 0;   // point number, from 0
+    int      value = 0;   // value of the scanned ASIC parameter
+    uint32_t nbAcq = 0;   // acquisitions read at this point
+    uint32_t hits[CITIROC_NB_CHANNELS] = {};  // hit bits per channel
+};
+
+// S-curve scan: steps one ASIC parameter (e.g. threshold1 or inputDac)
+// from start to stop, reading nbAcqPerPoint acquisitions at each point.
+// Run by the acquisition thread, see CITIROC_scanConfigure.
+struct CITIROC_scan {
+    bool active  = false;
+    int  field   = -1;    // index in CITIROC_asicFields
+    int  channel = -1;    // value of the field to step, -1 for all of them
+    int  start   = 0;
+    int  stop    = 0;
+    int  step    = 1;
+    int  nbAcqPerPoint = 1000;
+    int  nbPoints = 0;
+
+    CITIROC_scanPoint     point;  // being counted
+    std::vector<uint32_t> masks;  // hit masks of one cycle
+};
+
+// Public methods/ functions
+bool CITIROC_scanConfigure(CITIROC_scan* scan, const CITIROC_config& config);
+bool CITIROC_scanApply(const int CITIROC_usbID, const CITIROC_scan* scan);
+int  CITIROC_scanRemaining(const CITIROC_scan* scan);
+bool CITIROC_scanCount(CITIROC_scan* scan, const unsigned char* fifo20, const int nbAcq);
+bool CITIROC_scanNext(const int CITIROC_usbID, CITIROC_scan* scan);
+#endif
@@ -0,0 +1,73 @@
+/* Zero-suppressed (hit-only) readout format */
+#include "CITIROC_sparse.h"
+#include <string.h>
+
+int CITIROC_encodeSparse(const uint16_t* dataHG, const uint16_t* dataLG, const uint32_t* hits,
+                         const int nbAcq, const int nbChannels, const int* thresholds, uint32_t* sparse) {
+    /**
+     * Keep only the channels with a hit, or above their HG threshold.
+     * @param dataHG, dataLG: nbChannels channels + temperature sensor
+     * per acquisition, see CITIROC_decodeChannels.
+     * @param hits: hit masks, see CITIROC_decodeHits.
+     * @param thresholds: HG threshold of each channel, 0 for none; may be NULL.
+     * @param sparse: room for nbAcq*(nbChannels+1) words.
+     * @return number of words written.
+     */
+    const int stride = nbChannels + 1;
+    uint32_t* out = sparse;
+    for (int acq=0; acq<nbAcq; acq++) {
+        const uint16_t* acqHG = dataHG + acq*stride;
+        const uint16_t* acqLG = dataLG + acq*stride;
+        uint32_t* header = out++;
+        uint32_t  count  = 0;
+        for (int chn=0; chn<nbChannels; chn++) {
+            const uint32_t hit = (hits[acq] >> chn) & 1;
+            const bool above = thresholds != NULL && thresholds[chn] > 0 && acqHG[chn] > thresholds[chn];
+            if (!hit && !above) continue;
+            *out++ = ((uint32_t)(acqHG[chn] & CITIROC_SPARSE_ADC_MASK) << CITIROC_SPARSE_HG_SHIFT)
+                   | ((uint32_t)(acqLG[chn] & CITIROC_SPARSE_ADC_MASK) << CITIROC_SPARSE_LG_SHIFT)
+                   | ((uint32_t)chn << CITIROC_SPARSE_CHN_SHIFT)
+                   | (hit << CITIROC_SPARSE_HIT_SHIFT);
+            count++;
+        }
+        *header = count | ((uint32_t)(acqHG[nbChannels] & CITIROC_SPARSE_ADC_MASK) << CITIROC_SPARSE_TEMP_SHIFT);
+    }
+    return out - sparse;
+}
+
+int CITIROC_expandSparse(const uint32_t* sparse, const int nbSparse, const int nbChannels,
+                         uint16_t* dataHG, uint16_t* dataLG, uint32_t* hits) {
+    /**
+     * Expand a zero-suppressed cycle back to the layout of
+     * CITIROC_decodeChannels and CITIROC_decodeHits.
+     * Suppressed channels read 0. The temperature sensor is restored in HG only.
+     * @param nbSparse: number of words in sparse.
+     * @param dataHG, dataLG, hits: room for every acquisition of the cycle.
+     * @return number of acquisitions, -1 if the words are inconsistent.
+     */
+    const int stride = nbChannels + 1;
+    int nbAcq = 0;
+    int i = 0;
+    while (i < nbSparse) {
+        const uint32_t header = sparse[i++];
+        const int count = header & CITIROC_SPARSE_COUNT_MASK;
+        if (count > nbChannels || i + count > nbSparse) return -1;
+
+        uint16_t* acqHG = dataHG + nbAcq*stride;
+        uint16_t* acqLG = dataLG + nbAcq*stride;
+        memset(acqHG, 0, stride*sizeof(uint16_t));
+        memset(acqLG, 0, stride*sizeof(uint16_t));
+        acqHG[nbChannels] = (header >> CITIROC_SPARSE_TEMP_SHIFT) & CITIROC_SPARSE_ADC_MASK;
+        hits[nbAcq] = 0;
+        for (int k=0; k<count; k++) {
+            const uint32_t word = sparse[i++];
+            const int chn = (word >> CITIROC_SPARSE_CHN_SHIFT) & CITIROC_SPARSE_CHN_MASK;
+            if (chn >= nbChannels) return -1;
+            acqHG[chn] = (word >> CITIROC_SPARSE_HG_SHIFT) & CITIROC_SPARSE_ADC_MASK;
+            acqLG[chn] = (word >> CITIROC_SPARSE_LG_SHIFT) & CITIROC_SPARSE_ADC_MASK;
+            hits[nbAcq] |= (word >> CITIROC_SPARSE_HIT_SHIFT) << chn;
+        }
+        nbAcq++;
+    }
+    return nbAcq;
+}
@@ -0,0 +1,31 @@
+#ifndef CITIROC_SPARSE_H
+#define CITIROC_SPARSE_H
+
+#include <stdint.h>
+
+// Zero-suppressed cycle, as 32-bit words. For each acquisition:
+//
+//   header:  bits  0..5:  number n of channels kept
+//            bits 16..27: temperature sensor (HG word)
+//   n words: bits  0..11: HG ADC
+//            bits 12..23: LG ADC
+//            bits 24..28: channel
+//            bit  31:     hit
+//
+// A channel is kept if its hit bit is set, or if its HG value
+// is above a threshold of its own (0 disables the threshold).
+#define CITIROC_SPARSE_COUNT_MASK   0x3F
+#define CITIROC_SPARSE_TEMP_SHIFT   16
+#define CITIROC_SPARSE_HG_SHIFT     0
+#define CITIROC_SPARSE_LG_SHIFT     12
+#define CITIROC_SPARSE_CHN_SHIFT    24
+#define CITIROC_SPARSE_CHN_MASK     0x1F
+#define CITIROC_SPARSE_HIT_SHIFT    31
+#define CITIROC_SPARSE_ADC_MASK     0x0FFF
+
+// Public methods/ functions
+int CITIROC_encodeSparse(const uint16_t* dataHG, const uint16_t* dataLG, const uint32_t* hits,
+                         const int nbAcq, const int nbChannels, const int* thresholds, uint32_t* sparse);
+int CITIROC_expandSparse(const uint32_t* sparse, const int nbSparse, const int nbChannels,
+                         uint16_t* dataHG, uint16_t* dataLG, uint32_t* hits);
+#endif
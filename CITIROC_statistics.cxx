@@ -0,0 +1,74 @@
+/* Throughput and error statistics of the acquisition threads */
+#include "CITIROC.h"
+#include "CITIROC_statistics.h"
+#include <algorithm>
+
+void CITIROC_statisticsReset(CITIROC_statistics* statistics) {
+    /**
+     * Start over, e.g. with a new run; the next update gives no rates.
+     */
+    *statistics = CITIROC_statistics();
+}
+
+void CITIROC_statisticsUpdate(CITIROC_statistics* statistics, const CITIROC_acquisition* acquisition) {
+    /**
+     * Read the counters of the acquisition thread, without locking it,
+     * and derive the rates since the previous update.
+     * The counters only grow within a run; if they went back
+     * (new run without a reset), the rates are computed from zero.
+     */
+    const uint64_t now = CITIROC_monotonicNs();
+    const uint64_t cycles       = acquisition->cycles.load(std::memory_order_relaxed);
+    const uint64_t acquisitions = acquisition->acquisitions.load(std::memory_order_relaxed);
+    uint64_t bytes[4];
+    for (int k=0; k<4; k++) bytes[k] = acquisition->fifoBytes[k].load(std::memory_order_relaxed);
+    const uint64_t statusPolls  = acquisition->poller.polls.load(std::memory_order_relaxed);
+    const uint64_t liveTime     = acquisition->liveTime.load(std::memory_order_relaxed);
+    const uint64_t runTime      = CITIROC_runTime(acquisition);
+
+    if (cycles < statistics->lastCycles || acquisitions < statistics->lastAcquisitions ||
+        statusPolls < statistics->lastStatusPolls || liveTime < statistics->lastLiveTime) {
+        statistics->lastCycles       = 0;
+        statistics->lastAcquisitions = 0;
+        statistics->lastStatusPolls  = 0;
+        statistics->lastLiveTime     = 0;
+        for (int k=0; k<4; k++) statistics->lastBytes[k] = 0;
+    }
+    if (statistics->lastTime > 0 && now > statistics->lastTime) {
+        const double elapsed = 1e-9 * (now - statistics->lastTime);
+        statistics->cycleRate       = (cycles - statistics->lastCycles) / elapsed;
+        statistics->acquisitionRate = (acquisitions - statistics->lastAcquisitions) / elapsed;
+        for (int k=0; k<4; k++) {
+            statistics->byteRate[k] = (bytes[k] >= statistics->lastBytes[k]) ? (bytes[k] - statistics->lastBytes[k]) / elapsed : 0.;
+        }
+        // Cycles are counted live once queued, so a long cycle may overlap two updates
+        statistics->liveFraction = std::min(1., 1e-9 * (liveTime - statistics->lastLiveTime) / elapsed);
+    }
+    statistics->liveTime = 1e-9 * liveTime;
+    statistics->deadTime = (runTime > liveTime) ? 1e-9 * (runTime - liveTime) : 0.;
+    statistics->pollsPerCycle = (cycles > statistics->lastCycles) ? (double)(statusPolls - statistics->lastStatusPolls) / (cycles - statistics->lastCycles) : 0.;
+    statistics->fillTime      = 1e-3 * acquisition->poller.fillPerAcq.load(std::memory_order_relaxed) * acquisition->geometry.nbAcqInCycle;
+
+    const CITIROC_latencyHistogram& total = acquisition->latency.stage[CITIROC_LATENCY_TOTAL];
+    const uint64_t nbLatencies = total.count.load(std::memory_order_relaxed);
+    statistics->meanLatency = (nbLatencies > 0) ? 1e-3 * total.sum.load(std::memory_order_relaxed) / nbLatencies : 0.;
+    statistics->p99Latency  = 1e-3 * CITIROC_latencyPercentile(total, 0.99);
+
+    statistics->cycles       = cycles;
+    statistics->acquisitions = acquisitions;
+    statistics->restarts     = acquisition->restarts.load(std::memory_order_relaxed);
+    statistics->timeouts     = acquisition->timeouts.load(std::memory_order_relaxed);
+    statistics->shortReads   = acquisition->shortReads.load(std::memory_order_relaxed);
+    statistics->ringFull     = acquisition->ringFull.load(std::memory_order_relaxed);
+    statistics->usbErrors    = CITIROC_usbErrorCount(acquisition->usbID);
+    statistics->armErrors    = acquisition->armErrors.load(std::memory_order_relaxed);
+    statistics->droppedCycles = acquisition->droppedCycles.load(std::memory_order_relaxed);
+    statistics->statusPolls  = statusPolls;
+
+    statistics->lastTime         = now;
+    statistics->lastCycles       = cycles;
+    statistics->lastAcquisitions = acquisitions;
+    statistics->lastStatusPolls  = statusPolls;
+    statistics->lastLiveTime     = liveTime;
+    for (int k=0; k<4; k++) statistics->lastBytes[k] = bytes[k];
+}
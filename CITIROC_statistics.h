@@ -0,0 +1,46 @@
+#ifndef CITIROC_STATISTICS_H
+#define CITIROC_STATISTICS_H
+
+#include <stdint.h>
+#include "CITIROC_acquisition.h"
+
+// Throughput and error counters of one board, computed from the atomic
+// counters of its acquisition thread by CITIROC_statisticsUpdate.
+// Rates are over the time since the previous update;
+// totals since the start of the run, USB errors since the board was opened.
+struct CITIROC_statistics {
+    double cycleRate       = 0.;     // cycles/s
+    double acquisitionRate = 0.;     // acquisitions/s
+    double byteRate[4]     = {};     // bytes/s of FIFOs 20, 21, 23, 24
+    double meanLatency     = 0.;     // arming to banking, us
+    double p99Latency      = 0.;     // us
+    double pollsPerCycle   = 0.;     // subaddress 4 reads per cycle, adaptive polling
+    double fillTime        = 0.;     // expected time to fill a cycle, us, see CITIROC_poller
+    double liveFraction    = 0.;     // of the time since the previous update
+    double liveTime        = 0.;     // s, since the start of the run
+    double deadTime        = 0.;     // s
+
+    uint64_t cycles       = 0;
+    uint64_t acquisitions = 0;
+    uint32_t restarts     = 0;       // subaddress 22 asked for a new cycle
+    uint32_t timeouts     = 0;
+    uint32_t shortReads   = 0;       // a FIFO read returned fewer bytes than armed
+    uint32_t ringFull     = 0;
+    uint32_t usbErrors    = 0;       // see CITIROC_usbErrorCount
+    uint32_t armErrors    = 0;       // arming batches cut short by a USB transfer
+    uint32_t droppedCycles = 0;      // left in the ring at a stop or pause
+    uint64_t statusPolls  = 0;
+
+    // Previous update
+    uint64_t lastTime = 0;           // CITIROC_monotonicNs
+    uint64_t lastCycles = 0;
+    uint64_t lastAcquisitions = 0;
+    uint64_t lastStatusPolls = 0;
+    uint64_t lastLiveTime = 0;
+    uint64_t lastBytes[4] = {};
+};
+
+// Public methods/ functions
+void CITIROC_statisticsReset(CITIROC_statistics* statistics);
+void CITIROC_statisticsUpdate(CITIROC_statistics* statistics, const CITIROC_acquisition* acquisition);
+#endif
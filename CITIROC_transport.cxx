@@ -0,0 +1,108 @@
+/* Transport backends for the CITIROC API wrapper */
+#include "CITIROC_transport.h"
+#include <stdio.h>
+#include <atomic>
+
+#ifndef CITIROC_NO_HARDWARE
+#include "ftd2xx.h"
+#include "LALUsb.h"
+
+static int CITIROC_lalusbOpen(char* serialNumber) {
+    /**
+     * Generate the FTD2XX device list, then open the board with LALUsb.
+     * @return usb id, < 1 if the board could not be opened.
+     */
+    printf("FTD2XX: Generating FTD2XX device list...\n");
+    int FT_numberOfDevices;
+    FT_STATUS status = FT_CreateDeviceInfoList(&FT_numberOfDevices);
+    if (status != FT_OK) {return 0;}
+    printf("LALUSB: %d USB devices found. Trying to connect with the board...\n", USB_GetNumberOfDevs());
+    return OpenUsbDevice(serialNumber);
+}
+
+static void CITIROC_lalusbClose(int usbID) {CloseUsbDevice(usbID);}
+static bool CITIROC_lalusbInit(int usbID) {return USB_Init(usbID, true);}
+static bool CITIROC_lalusbReset(int usbID) {return USB_ResetDevice(usbID);}
+static bool CITIROC_lalusbSetXferSize(int usbID, int rxsize, int txsize) {return USB_SetXferSize(usbID, rxsize, txsize);}
+static bool CITIROC_lalusbSetTimeouts(int usbID, int ttimeout, int rtimeout) {return USB_SetTimeouts(usbID, ttimeout, rtimeout);}
+static int  CITIROC_lalusbWrite(int usbID, char subAddress, void* buffer, int count) {return UsbWrt(usbID, subAddress, buffer, count);}
+static int  CITIROC_lalusbRead(int usbID, char subAddress, void* buffer, int count) {return UsbRd(usbID, subAddress, buffer, count);}
+static int  CITIROC_lalusbLastError() {return USB_GetLastError();}
+static void CITIROC_lalusbPerror(int error) {USB_Perror(error);}
+
+const CITIROC_transport CITIROC_transportLALUsb = {
+    "LALUsb",
+    CITIROC_lalusbOpen,
+    CITIROC_lalusbClose,
+    CITIROC_lalusbInit,
+    CITIROC_lalusbReset,
+    CITIROC_lalusbSetXferSize,
+    CITIROC_lalusbSetTimeouts,
+    CITIROC_lalusbWrite,
+    CITIROC_lalusbRead,
+    CITIROC_lalusbLastError,
+    CITIROC_lalusbPerror,
+};
+
+static const CITIROC_transport* CITIROC_activeTransport = &CITIROC_transportLALUsb;
+#else
+static const CITIROC_transport* CITIROC_activeTransport = &CITIROC_transportEmulator;
+#endif
+
+void CITIROC_setTransport(const CITIROC_transport* transport) {
+    /**
+     * Select the backend used by all CITIROC_* functions.
+     * Call this before CITIROC_connect.
+     */
+    printf("CITIROC: Using %s transport.\n", transport->name);
+    CITIROC_activeTransport = transport;
+}
+
+const CITIROC_transport* CITIROC_getTransport() {return CITIROC_activeTransport;}
+
+// Failed or short transfers with an error set by the backend, per usb id.
+static std::atomic<uint32_t> CITIROC_usbErrors[CITIROC_USB_MAX_IDS];
+
+static void CITIROC_usbCountError(const int usbID) {
+    if (CITIROC_activeTransport->lastError() == 0) return;
+    CITIROC_usbErrors[(unsigned)usbID % CITIROC_USB_MAX_IDS].fetch_add(1, std::memory_order_relaxed);
+}
+
+uint32_t CITIROC_usbErrorCount(const int usbID) {
+    /**
+     * @return transfers of this board that moved fewer bytes than asked
+     * while the backend reported an error (USB_GetLastError for LALUsb).
+     * The backends keep one last error for all boards,
+     * so with several boards an error may be counted on the wrong one.
+     */
+    return CITIROC_usbErrors[(unsigned)usbID % CITIROC_USB_MAX_IDS].load(std::memory_order_relaxed);
+}
+
+int  CITIROC_usbOpen(char* serialNumber) {return CITIROC_activeTransport->open(serialNumber);}
+void CITIROC_usbClose(const int usbID) {CITIROC_activeTransport->close(usbID);}
+bool CITIROC_usbInit(const int usbID) {return CITIROC_activeTransport->init(usbID);}
+bool CITIROC_usbReset(const int usbID) {return CITIROC_activeTransport->reset(usbID);}
+
+bool CITIROC_usbSetXferSize(const int usbID, const int rxsize, const int txsize) {
+    return CITIROC_activeTransport->setXferSize(usbID, rxsize, txsize);
+}
+
+bool CITIROC_usbSetTimeouts(const int usbID, const int ttimeout, const int rtimeout) {
+    return CITIROC_activeTransport->setTimeouts(usbID, ttimeout, rtimeout);
+}
+
+int CITIROC_usbWrite(const int usbID, const char subAddress, void* buffer, const int count) {
+    const int nbWritten = CITIROC_activeTransport->write(usbID, subAddress, buffer, count);
+    if (nbWritten != count) CITIROC_usbCountError(usbID);
+    return nbWritten;
+}
+
+int CITIROC_usbRead(const int usbID, const char subAddress, void* buffer, const int count) {
+    const int nbRead = CITIROC_activeTransport->read(usbID, subAddress, buffer, count);
+    if (nbRead != count) CITIROC_usbCountError(usbID);
+    return nbRead;
+}
+
+void CITIROC_usbPerror() {
+    CITIROC_activeTransport->perror(CITIROC_activeTransport->lastError());
+}
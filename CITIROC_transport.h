@@ -0,0 +1,44 @@
+#ifndef CITIROC_TRANSPORT_H
+#define CITIROC_TRANSPORT_H
+
+#include <stdint.h>
+
+// Usb ids are folded into this many error counters.
+#define CITIROC_USB_MAX_IDS 64
+
+// Functions used by the CITIROC API to talk to the board.
+// The LALUsb backend talks to the FT2232HL on the CITIROC1A board;
+// the emulator backend models the FPGA register file in software.
+struct CITIROC_transport {
+    const char* name;
+    int  (*open)(char* serialNumber);
+    void (*close)(int usbID);
+    bool (*init)(int usbID);
+    bool (*reset)(int usbID);
+    bool (*setXferSize)(int usbID, int rxsize, int txsize);
+    bool (*setTimeouts)(int usbID, int ttimeout, int rtimeout);
+    int  (*write)(int usbID, char subAddress, void* buffer, int count);
+    int  (*read)(int usbID, char subAddress, void* buffer, int count);
+    int  (*lastError)();
+    void (*perror)(int error);
+};
+
+#ifndef CITIROC_NO_HARDWARE
+extern const CITIROC_transport CITIROC_transportLALUsb;
+#endif
+extern const CITIROC_transport CITIROC_transportEmulator;
+
+// Public methods/ functions
+void CITIROC_setTransport(const CITIROC_transport* transport);
+const CITIROC_transport* CITIROC_getTransport();
+int  CITIROC_usbOpen(char* serialNumber);
+void CITIROC_usbClose(const int usbID);
+bool CITIROC_usbInit(const int usbID);
+bool CITIROC_usbReset(const int usbID);
+bool CITIROC_usbSetXferSize(const int usbID, const int rxsize, const int txsize);
+bool CITIROC_usbSetTimeouts(const int usbID, const int ttimeout, const int rtimeout);
+int  CITIROC_usbWrite(const int usbID, const char subAddress, void* buffer, const int count);
+int  CITIROC_usbRead(const int usbID, const char subAddress, void* buffer, const int count);
+void CITIROC_usbPerror();
+uint32_t CITIROC_usbErrorCount(const int usbID);
+#endif
@@ -0,0 +1,148 @@
+/* Asynchronous side-channel writer for decoded cycles */
+#include "CITIROC_writer.h"
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+#define CITIROC_WRITER_BUFFER (1 << 20) // bytes buffered before each write to disk
+
+static void CITIROC_writeRecord(FILE* file, const int format, const CITIROC_writerRecord& record) {
+    const int stride  = record.nbChannels + 1;
+    const int nbWords = record.nbAcq * stride;
+
+    if (format == CITIROC_WRITER_BINARY) {
+        const uint32_t header[2] = {CITIROC_WRITER_MAGIC, record.cycleNumber};
+        const int64_t  timestamp = record.timestamp;
+        const uint32_t sizes[2]  = {(uint32_t)record.nbAcq, (uint32_t)record.nbChannels};
+        fwrite(header,     sizeof(header),    1, file);
+        fwrite(&timestamp, sizeof(timestamp), 1, file);
+        fwrite(sizes,      sizeof(sizes),     1, file);
+        fwrite(record.hg.data(),   sizeof(uint16_t), nbWords, file);
+        fwrite(record.lg.data(),   sizeof(uint16_t), nbWords, file);
+        fwrite(record.hits.data(), sizeof(uint32_t), record.nbAcq, file);
+        return;
+    }
+
+    // CSV: cycle, acquisition, time, hit mask, HG values, LG values
+    for (int acq=0; acq<record.nbAcq; acq++) {
+        fprintf(file, "%u,%d,%lld,0x%08x", record.cycleNumber, acq, record.timestamp, record.hits[acq]);
+        for (int chn=0; chn<stride; chn++) fprintf(file, ",%u", record.hg[acq*stride + chn]);
+        for (int chn=0; chn<stride; chn++) fprintf(file, ",%u", record.lg[acq*stride + chn]);
+        fputc('\n', file);
+    }
+}
+
+static void CITIROC_writerLoop(CITIROC_writer* writer) {
+    /**
+     * Write queued records until CITIROC_stopWriter,
+     * then drain the queue.
+     */
+    while (true) {
+        CITIROC_writerRecord* record = writer->queue.readSlot();
+        if (record == NULL) {
+            // Look again once stopped: the last record may have been
+            // queued between the first look and CITIROC_stopWriter
+            if (!writer->running.load()) {
+                if (writer->queue.readSlot() != NULL) continue;
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+        CITIROC_writeRecord(writer->file, writer->format, *record);
+        writer->queue.release();
+        writer->written++;
+    }
+}
+
+bool CITIROC_startWriter(CITIROC_writer* writer, const char* directory, const int runNumber, const int board,
+                         const int format, const int queueSize, const CITIROC_geometry& geometry) {
+    /**
+     * Open <directory>/citiroc_run<runNumber>.bin (or .csv)
+     * and start the writer thread. A leading "~/" stands for $HOME.
+     * @param board: index of the board in the frontend; the files of
+     *               boards other than 0 end in _board<board>.
+     * The queue slots are sized here for cycles of the given geometry.
+     * @param format: CITIROC_WRITER_BINARY or CITIROC_WRITER_CSV;
+     *                CITIROC_WRITER_OFF starts nothing.
+     * @param queueSize: cycles buffered before CITIROC_pushCycle drops them.
+     * @return true if the file is open and the thread running.
+     */
+    if (writer->running || format == CITIROC_WRITER_OFF || queueSize < 1) return false;
+
+    char fileName[1024];
+    const char* home = getenv("HOME");
+    const char* extension = (format == CITIROC_WRITER_CSV) ? "csv" : "bin";
+    char suffix[32] = "";
+    if (board > 0) snprintf(suffix, sizeof(suffix), "_board%d", board);
+    if (strncmp(directory, "~/", 2) == 0 && home != NULL) {
+        snprintf(fileName, sizeof(fileName), "%s/%s/citiroc_run%05d%s.%s", home, directory+2, runNumber, suffix, extension);
+    } else {
+        snprintf(fileName, sizeof(fileName), "%s/citiroc_run%05d%s.%s", directory, runNumber, suffix, extension);
+    }
+
+    writer->file = fopen(fileName, (format == CITIROC_WRITER_CSV) ? "w" : "wb");
+    if (writer->file == NULL) {
+        printf("CITIROC: Unable to open side-channel file %s\n", fileName);
+        return false;
+    }
+    writer->fileBuffer.resize(CITIROC_WRITER_BUFFER);
+    setvbuf(writer->file, writer->fileBuffer.data(), _IOFBF, writer->fileBuffer.size());
+
+    const size_t nbWords = (size_t)geometry.nbAcqInCycle * (geometry.nbChannels + 1);
+    writer->queue.resize(queueSize);
+    writer->queue.forEach([&](CITIROC_writerRecord& record) {
+        record.hg.resize(nbWords);
+        record.lg.resize(nbWords);
+        record.hits.resize(geometry.nbAcqInCycle);
+    });
+    writer->format  = format;
+    writer->written = 0;
+    writer->dropped = 0;
+
+    printf("CITIROC: Writing decoded cycles to %s\n", fileName);
+    writer->running = true;
+    writer->thread  = std::thread(CITIROC_writerLoop, writer);
+    return true;
+}
+
+bool CITIROC_pushCycle(CITIROC_writer* writer, const uint32_t cycleNumber, const long long timestamp,
+                       const int nbAcq, const int nbChannels,
+                       const uint16_t* hg, const uint16_t* lg, const uint32_t* hits) {
+    /**
+     * Queue a decoded cycle for the writer thread. Never blocks:
+     * the cycle is dropped (and counted) if the queue is full.
+     * @param hg, lg: nbAcq*(nbChannels+1) words, as in the C1HG/C1LG banks.
+     * @param hits: nbAcq masks, as in the C1HT bank.
+     * @return true if the cycle was queued.
+     */
+    if (!writer->running.load(std::memory_order_relaxed)) return false;
+    CITIROC_writerRecord* record = writer->queue.writeSlot();
+    const size_t nbWords = (size_t)nbAcq * (nbChannels + 1);
+    if (record == NULL || nbWords > record->hg.size() || (size_t)nbAcq > record->hits.size()) {
+        writer->dropped++;
+        return false;
+    }
+    record->cycleNumber = cycleNumber;
+    record->timestamp   = timestamp;
+    record->nbAcq       = nbAcq;
+    record->nbChannels  = nbChannels;
+    memcpy(record->hg.data(),   hg,   nbWords * sizeof(uint16_t));
+    memcpy(record->lg.data(),   lg,   nbWords * sizeof(uint16_t));
+    memcpy(record->hits.data(), hits, nbAcq * sizeof(uint32_t));
+    writer->queue.commit();
+    return true;
+}
+
+void CITIROC_stopWriter(CITIROC_writer* writer) {
+    /**
+     * Write the cycles still queued, stop the thread and close the file.
+     */
+    if (!writer->running) return;
+    writer->running = false;
+    if (writer->thread.joinable()) writer->thread.join();
+    fclose(writer->file);
+    writer->file = NULL;
+    printf("CITIROC: Side-channel writer stopped after %u cycles (%u dropped)\n",
+           writer->written.load(), writer->dropped.load());
+}
@@ -0,0 +1,59 @@
+#ifndef CITIROC_WRITER_H
+#define CITIROC_WRITER_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "CITIROC_acquisition.h"
+
+// Side-channel file formats, see CITIROC_startWriter.
+#define CITIROC_WRITER_OFF    0
+#define CITIROC_WRITER_BINARY 1
+#define CITIROC_WRITER_CSV    2
+
+// Binary records, one per cycle, in host byte order:
+//   uint32_t  magic (CITIROC_WRITER_MAGIC)
+//   uint32_t  cycle number
+//   int64_t   time, ms
+//   uint32_t  acquisitions (nbAcq)
+//   uint32_t  channels (nbChannels)
+//   uint16_t  HG[nbAcq*(nbChannels+1)], temperature sensor last
+//   uint16_t  LG[nbAcq*(nbChannels+1)]
+//   uint32_t  hit masks[nbAcq]
+#define CITIROC_WRITER_MAGIC 0x43524331 // "C1RC"
+
+// Decoded cycle queued for the side-channel file.
+struct CITIROC_writerRecord {
+    uint32_t  cycleNumber = 0;
+    long long timestamp   = 0;  // ms
+    int nbAcq      = 0;
+    int nbChannels = 0;
+    std::vector<uint16_t> hg;
+    std::vector<uint16_t> lg;
+    std::vector<uint32_t> hits;
+};
+
+// Background thread writing the decoded cycles to a per-run file,
+// so that the readout never waits for the disk.
+struct CITIROC_writer {
+    int   format = CITIROC_WRITER_OFF;
+    FILE* file   = NULL;
+    std::vector<char> fileBuffer;
+    CITIROC_ring<CITIROC_writerRecord> queue;
+    std::thread       thread;
+    std::atomic<bool> running{false};
+
+    std::atomic<uint32_t> written{0};   // cycles written
+    std::atomic<uint32_t> dropped{0};   // cycles lost to a full queue
+};
+
+// Public methods/ functions
+bool CITIROC_startWriter(CITIROC_writer* writer, const char* directory, const int runNumber, const int board,
+                         const int format, const int queueSize, const CITIROC_geometry& geometry);
+bool CITIROC_pushCycle(CITIROC_writer* writer, const uint32_t cycleNumber, const long long timestamp,
+                       const int nbAcq, const int nbChannels,
+                       const uint16_t* hg, const uint16_t* lg, const uint32_t* hits);
+void CITIROC_stopWriter(CITIROC_writer* writer);
+#endif
@@ -0,0 +1,123 @@
+/********************************************************************\
+Check the event builder on hand-filled rings.
+
+  citiroc_buildtest
+
+Cycles with chosen cycle numbers and readout times are queued in the
+rings of two boards, then CITIROC_builderNext is run until the rings
+are empty. Cases: aligned rings with windows of 0 and 1 cycle, a cycle
+missing on one board, a fragment arriving after its event timed out,
+boards offset by one cycle within the window, and time matching.
+The events, complete events and late fragments must match the
+expected counts.
+Builds without MIDAS: make citiroc_buildtest.exe
+\********************************************************************/
+
+#include <stdio.h>
+#include <vector>
+#include "CITIROC_builder.h"
+
+// Ring access of the acquisition threads (CITIROC_acquisition.cxx),
+// which would pull in the USB and MIDAS code
+CITIROC_rawCycle* CITIROC_nextCycle(CITIROC_acquisition* acquisition) {
+    return acquisition->ring.readSlot();
+}
+
+void CITIROC_releaseCycle(CITIROC_acquisition* acquisition) {
+    acquisition->ring.release();
+}
+
+static void buildtest_queue(CITIROC_acquisition* acquisition, const uint32_t cycleNumber, const long long hostTime) {
+    CITIROC_rawCycle* cycle = acquisition->ring.writeSlot();
+    if (cycle == NULL) {printf("Ring full\n"); return;}
+    cycle->cycleNumber = cycleNumber;
+    cycle->hostTime    = hostTime;
+    acquisition->ring.commit();
+}
+
+struct buildtest_counts {
+    int events   = 0;
+    int complete = 0;
+    int late     = 0;
+};
+
+static buildtest_counts buildtest_drain(CITIROC_builder* builder, const long long now) {
+    buildtest_counts counts;
+    CITIROC_builtEvent event;
+    while (CITIROC_builderNext(builder, now, &event)) {
+        counts.events++;
+        if (event.mask == 3) counts.complete++;
+        if (event.late) counts.late++;
+        CITIROC_builderRelease(builder, &event);
+    }
+    return counts;
+}
+
+static int buildtest_expect(const char* name, const buildtest_counts& counts, const int events, const int complete, const int late) {
+    const bool ok = counts.events == events && counts.complete == complete && counts.late == late;
+    printf("%-40s %2d events, %2d complete, %2d late: %s\n", name, counts.events, counts.complete, counts.late, ok ? "OK" : "FAILED");
+    return ok ? 0 : 1;
+}
+
+int main() {
+    static CITIROC_acquisition boards[2];
+    CITIROC_acquisition* acquisitions[2] = {&boards[0], &boards[1]};
+    CITIROC_builder builder;
+    int nbErrors = 0;
+
+    for (int window=0; window<=1; window++) {
+        for (CITIROC_acquisition& board: boards) board.ring.resize(8);
+        CITIROC_builderReset(&builder, acquisitions, 2, CITIROC_BUILD_CYCLE, window, 0);
+        for (uint32_t n=0; n<4; n++) {
+            buildtest_queue(&boards[0], n, 0);
+            buildtest_queue(&boards[1], n, 0);
+        }
+        nbErrors += buildtest_expect(window ? "aligned, window 1" : "aligned, window 0", buildtest_drain(&builder, 0), 4, 4, 0);
+    }
+
+    // Cycle 2 lost on board 1: a lone fragment, not late, the others still match
+    for (CITIROC_acquisition& board: boards) board.ring.resize(8);
+    CITIROC_builderReset(&builder, acquisitions, 2, CITIROC_BUILD_CYCLE, 0, 0);
+    for (uint32_t n=0; n<4; n++) {
+        buildtest_queue(&boards[0], n, 0);
+        if (n != 2) buildtest_queue(&boards[1], n, 0);
+    }
+    nbErrors += buildtest_expect("cycle missing on board 1", buildtest_drain(&builder, 0), 4, 3, 0);
+
+    // Board 1 still running with an empty ring: cycle 0 is built alone
+    // after the timeout, then its cycle 0 arrives late
+    for (CITIROC_acquisition& board: boards) board.ring.resize(8);
+    boards[1].running = true;
+    CITIROC_builderReset(&builder, acquisitions, 2, CITIROC_BUILD_CYCLE, 1, 1000);
+    buildtest_queue(&boards[0], 0, 0);
+    buildtest_queue(&boards[0], 1, 0);
+    buildtest_counts counts = buildtest_drain(&builder, 0);
+    nbErrors += buildtest_expect("empty ring, before the timeout", counts, 0, 0, 0);
+    counts = buildtest_drain(&builder, 2000);
+    buildtest_queue(&boards[1], 0, 0);
+    buildtest_queue(&boards[1], 1, 0);
+    boards[1].running = false;
+    const buildtest_counts after = buildtest_drain(&builder, 2000);
+    counts.events += after.events; counts.complete += after.complete; counts.late += after.late;
+    nbErrors += buildtest_expect("fragment after the timeout", counts, 3, 1, 1);
+
+    // Board 1 one cycle ahead, window 1: every pair matches
+    for (CITIROC_acquisition& board: boards) board.ring.resize(8);
+    CITIROC_builderReset(&builder, acquisitions, 2, CITIROC_BUILD_CYCLE, 1, 0);
+    for (uint32_t n=0; n<4; n++) {
+        buildtest_queue(&boards[0], n, 0);
+        buildtest_queue(&boards[1], n + 1, 0);
+    }
+    nbErrors += buildtest_expect("offset by one, window 1", buildtest_drain(&builder, 0), 4, 4, 0);
+
+    // Readout times 1000 us apart with 30 us of jitter, window 50 us
+    for (CITIROC_acquisition& board: boards) board.ring.resize(8);
+    CITIROC_builderReset(&builder, acquisitions, 2, CITIROC_BUILD_TIME, 50, 0);
+    for (uint32_t n=0; n<4; n++) {
+        buildtest_queue(&boards[0], n, 1000 * (n + 1));
+        buildtest_queue(&boards[1], n + 7, 1000 * (n + 1) + ((n % 2) ? 30 : -30));
+    }
+    nbErrors += buildtest_expect("time matching, window 50 us", buildtest_drain(&builder, 0), 4, 4, 0);
+
+    return (nbErrors == 0) ? 0 : 1;
+}
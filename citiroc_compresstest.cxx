@@ -0,0 +1,168 @@
+/********************************************************************\
+Check the C1CZ codecs: round trips and corrupted cycles.
+
+  citiroc_compresstest
+
+Round trips: cycles of random bytes, of constant pedestals and of
+pedestals with a few hits, for 1 to 255 acquisitions, with the PACK and
+ZLIB codecs, must come back byte for byte. A cycle of constant
+pedestals must pack to one 136-bit block per gain and acquisition
+after the first (width 0, flags only).
+Corruption: bad magic or codec, 0 or too many acquisitions
+(0x7fffffff included), payload sizes out of range for the codec,
+truncated cycles and trailing bytes must return -1 without throwing;
+flipped payload bits must return -1 or the original bytes.
+Builds without MIDAS: make citiroc_compresstest.exe
+\********************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "CITIROC_compress.h"
+#include "CITIROC_decoder.h"
+
+#define COMPRESSTEST_RANDOM    0
+#define COMPRESSTEST_CONSTANT  1
+#define COMPRESSTEST_HITS      2
+
+static void compresstest_fill(const int kind, const int nbAcq, std::vector<unsigned char>* fifo) {
+    /**
+     * FIFO bytes of a cycle: HG word (fifo21 << 8) | fifo20, LG word (fifo24 << 8) | fifo23,
+     * ADC in bits 4..15, flags in bits 0..3.
+     */
+    const int nbBytes = nbAcq * CITIROC_WORDS_PER_ACQ;
+    for (int k=0; k<4; k++) fifo[k].resize(nbBytes);
+    for (int j=0; j<nbBytes; j++) {
+        const int chn = j % CITIROC_WORDS_PER_ACQ;
+        for (int gain=0; gain<2; gain++) {
+            int word;
+            if (kind == COMPRESSTEST_RANDOM) word = rand() & 0xFFFF;
+            else {
+                int adc = 200 + 3 * chn + 50 * gain;
+                if (kind == COMPRESSTEST_HITS) adc += (rand() % 10 == 0) ? rand() % 3000 : rand() % 5 - 2;
+                word = (adc << 4) | ((kind == COMPRESSTEST_HITS && gain == 0) ? rand() & 0x0D : 0x1);
+            }
+            fifo[2*gain][j]   = word & 0xFF;
+            fifo[2*gain+1][j] = word >> 8;
+        }
+    }
+}
+
+static bool compresstest_roundTrip(const int kind, const int nbAcq, const int codec, int* size) {
+    std::vector<unsigned char> fifo[4], restored[4], compressed;
+    compresstest_fill(kind, nbAcq, fifo);
+    const unsigned char* raw[4] = {fifo[0].data(), fifo[1].data(), fifo[2].data(), fifo[3].data()};
+    *size = CITIROC_compressCycle(raw, nbAcq, codec, 6, &compressed);
+    if (*size < 0) return false;
+    if (CITIROC_decompressCycle(compressed.data(), compressed.size(), restored) != nbAcq) return false;
+    for (int k=0; k<4; k++) {
+        if (restored[k] != fifo[k]) return false;
+    }
+    return true;
+}
+
+static int compresstest_expectCorrupted(const char* name, const std::vector<unsigned char>& compressed) {
+    std::vector<unsigned char> restored[4];
+    const int status = CITIROC_decompressCycle(compressed.data(), compressed.size(), restored);
+    if (status == -1) return 0;
+    printf("%s: returned %d instead of -1\n", name, status);
+    return 1;
+}
+
+int main() {
+    int nbErrors = 0;
+    srand(12345);
+
+    // Round trips
+    const int codecs[2] = {CITIROC_CODEC_PACK, CITIROC_CODEC_ZLIB};
+    for (int codec: codecs) {
+        int nbFailed = 0, size;
+        for (int kind=COMPRESSTEST_RANDOM; kind<=COMPRESSTEST_HITS; kind++) {
+            for (int nbAcq=1; nbAcq<=255; nbAcq++) {
+                if (!compresstest_roundTrip(kind, nbAcq, codec, &size)) nbFailed++;
+            }
+        }
+        printf("%s: %d of %d round trips failed\n", (codec == CITIROC_CODEC_PACK) ? "PACK" : "ZLIB", nbFailed, 3 * 255);
+        nbErrors += nbFailed;
+    }
+
+    // Constant pedestals: every block after the first has zero deltas
+    const int nbAcq = 100;
+    int size = 0;
+    compresstest_roundTrip(COMPRESSTEST_CONSTANT, nbAcq, CITIROC_CODEC_PACK, &size);
+    const int nbPayload = size - (int)sizeof(CITIROC_compressHeader);
+    const int flagsOnly = 2 * (nbAcq - 1) * (4 + 4 * CITIROC_WORDS_PER_ACQ) / 8;
+    const int firstMax  = 2 * (4 + CITIROC_WORDS_PER_ACQ * (14 + 14 + 4)) / 8 + 1;
+    const bool packed = nbPayload <= flagsOnly + firstMax;
+    printf("PACK, %d acquisitions of constant pedestals: %d payload bytes (at most %d): %s\n",
+           nbAcq, nbPayload, flagsOnly + firstMax, packed ? "OK" : "FAILED");
+    if (!packed) nbErrors++;
+
+    // Corrupted cycles
+    std::vector<unsigned char> fifo[4], good[2];
+    compresstest_fill(COMPRESSTEST_HITS, nbAcq, fifo);
+    const unsigned char* raw[4] = {fifo[0].data(), fifo[1].data(), fifo[2].data(), fifo[3].data()};
+    int nbCorruption = 0;
+    for (int c=0; c<2; c++) {
+        CITIROC_compressCycle(raw, nbAcq, codecs[c], 6, &good[c]);
+        CITIROC_compressHeader header;
+        memcpy(&header, good[c].data(), sizeof(header));
+        const uint32_t nbAcqs[4] = {0, 256, 0x10000, 0x7fffffff};
+        for (uint32_t bad: nbAcqs) {
+            std::vector<unsigned char> cycle = good[c];
+            CITIROC_compressHeader h = header;
+            h.nbAcq = bad;
+            memcpy(cycle.data(), &h, sizeof(h));
+            nbCorruption += compresstest_expectCorrupted("nbAcq", cycle);
+        }
+        std::vector<unsigned char> cycle = good[c];
+        cycle[0] ^= 1;
+        nbCorruption += compresstest_expectCorrupted("magic", cycle);
+
+        cycle = good[c];
+        CITIROC_compressHeader h = header;
+        h.codec = CITIROC_CODEC_NONE;
+        memcpy(cycle.data(), &h, sizeof(h));
+        nbCorruption += compresstest_expectCorrupted("codec", cycle);
+
+        cycle = good[c];
+        cycle.resize(cycle.size() - 1);
+        nbCorruption += compresstest_expectCorrupted("truncated", cycle);
+
+        cycle = good[c];
+        cycle.resize(sizeof(header) - 1);
+        nbCorruption += compresstest_expectCorrupted("header only", cycle);
+
+        cycle = good[c];
+        h = header;
+        h.nbPayload = 1;
+        memcpy(cycle.data(), &h, sizeof(h));
+        nbCorruption += compresstest_expectCorrupted("short payload", cycle);
+
+        cycle = good[c];
+        cycle.push_back(0);
+        h = header;
+        h.nbPayload++;
+        memcpy(cycle.data(), &h, sizeof(h));
+        nbCorruption += compresstest_expectCorrupted("trailing byte", cycle);
+
+        // A flipped bit may still decode to the same bytes (redundant deflate codes)
+        int nbFlipped = 0, nbCaught = 0;
+        for (size_t j=sizeof(header); j<good[c].size(); j+=7, nbFlipped++) {
+            cycle = good[c];
+            cycle[j] ^= 0x10;
+            std::vector<unsigned char> restored[4];
+            if (CITIROC_decompressCycle(cycle.data(), cycle.size(), restored) == -1) {nbCaught++; continue;}
+            for (int k=0; k<4; k++) {
+                if (restored[k] != fifo[k]) {printf("flipped bit: byte %zu decoded to different data\n", j); nbCorruption++; break;}
+            }
+        }
+        printf("%s, flipped bits: %d of %d caught\n", (codecs[c] == CITIROC_CODEC_PACK) ? "PACK" : "ZLIB", nbCaught, nbFlipped);
+    }
+    printf("Corrupted cycles: %d accepted\n", nbCorruption);
+    nbErrors += nbCorruption;
+
+    return (nbErrors == 0) ? 0 : 1;
+}
@@ -0,0 +1,132 @@
+/********************************************************************\
+Throughput and cross-check of the decoder implementations.
+
+  citiroc_decodebench [acquisitions per cycle] [seconds per path]
+
+For each implementation available on this CPU (CITIROC_setDecoderPath),
+the SSE2 and AVX2 outputs are first compared with the scalar one:
+CITIROC_decodeFIFO on every length from 0 to 200 words,
+so that every tail left by the 16- and 32-word loops is covered,
+then CITIROC_decodeCycle on every cycle size from 1 to 255 acquisitions.
+Then CITIROC_decodeCycle is timed on random FIFO bytes
+(100 acquisitions per cycle and 1 s per path by default)
+and the throughput is printed in words/s.
+Builds without MIDAS: make citiroc_decodebench.exe
+\********************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include "CITIROC_decoder.h"
+
+#define DECODEBENCH_MAX_WORDS 200
+#define DECODEBENCH_SENTINEL  0xA5
+
+// Keeps the timed decoding from being optimised away
+static volatile unsigned long long decodebench_sink = 0;
+
+static const char* decodebench_pathName(const int path) {
+    switch (path) {
+    case CITIROC_DECODER_SCALAR: return "scalar";
+    case CITIROC_DECODER_SSE2:   return "SSE2";
+    case CITIROC_DECODER_AVX2:   return "AVX2";
+    default:                     return "auto";
+    }
+}
+
+// Decoded words, with DECODEBENCH_SENTINEL one past the end to catch overruns
+struct decodebench_output {
+    uint16_t hg[DECODEBENCH_MAX_WORDS+1], lg[DECODEBENCH_MAX_WORDS+1];
+    uint8_t  hit[DECODEBENCH_MAX_WORDS+1], otrHG[DECODEBENCH_MAX_WORDS+1], otrLG[DECODEBENCH_MAX_WORDS+1];
+};
+
+static void decodebench_decode(const unsigned char* const* fifo, const int nbWords, decodebench_output* out) {
+    memset(out, DECODEBENCH_SENTINEL, sizeof(*out));
+    CITIROC_decodeFIFO(fifo[0], fifo[1], fifo[2], fifo[3], nbWords, out->hg, out->lg, out->hit, out->otrHG, out->otrLG);
+}
+
+static int decodebench_check(const int path, const unsigned char* const* fifo) {
+    /**
+     * Compare the output of path with the scalar one.
+     * @return number of lengths and cycle sizes that differ.
+     */
+    int nbErrors = 0;
+    static decodebench_output expected, decoded;
+    for (int nbWords=0; nbWords<=DECODEBENCH_MAX_WORDS; nbWords++) {
+        CITIROC_setDecoderPath(CITIROC_DECODER_SCALAR);
+        decodebench_decode(fifo, nbWords, &expected);
+        CITIROC_setDecoderPath(path);
+        decodebench_decode(fifo, nbWords, &decoded);
+        if (memcmp(&expected, &decoded, sizeof(expected)) != 0) {
+            if (nbErrors++ < 10) printf("%s: %d words differ from scalar\n", decodebench_pathName(path), nbWords);
+        }
+    }
+
+    CITIROC_cycleData expectedCycle, decodedCycle;
+    for (int nbAcq=1; nbAcq<=255; nbAcq++) {
+        CITIROC_setDecoderPath(CITIROC_DECODER_SCALAR);
+        CITIROC_decodeCycle(fifo[0], fifo[1], fifo[2], fifo[3], nbAcq, &expectedCycle);
+        CITIROC_setDecoderPath(path);
+        CITIROC_decodeCycle(fifo[0], fifo[1], fifo[2], fifo[3], nbAcq, &decodedCycle);
+        if (expectedCycle.hg != decodedCycle.hg || expectedCycle.lg != decodedCycle.lg || expectedCycle.hit != decodedCycle.hit
+            || expectedCycle.otrHG != decodedCycle.otrHG || expectedCycle.otrLG != decodedCycle.otrLG) {
+            if (nbErrors++ < 10) printf("%s: cycle of %d acquisitions differs from scalar\n", decodebench_pathName(path), nbAcq);
+        }
+    }
+    return nbErrors;
+}
+
+int main(int argc, char** argv) {
+    const int    nbAcqInCycle = (argc > 1) ? atoi(argv[1]) : 100;
+    const double seconds      = (argc > 2) ? atof(argv[2]) : 1.;
+    if (nbAcqInCycle < 1 || nbAcqInCycle > 255 || seconds <= 0.) {
+        printf("Usage: %s [acquisitions per cycle, 1 to 255] [seconds per path]\n", argv[0]);
+        return 1;
+    }
+
+    // Random FIFO bytes, enough for the largest cycle
+    const int nbBytes = 255 * CITIROC_WORDS_PER_ACQ;
+    std::vector<unsigned char> bytes[4];
+    srand(12345);
+    for (int k=0; k<4; k++) {
+        bytes[k].resize(nbBytes);
+        for (int j=0; j<nbBytes; j++) bytes[k][j] = rand() & 0xFF;
+    }
+    const unsigned char* fifo[4] = {bytes[0].data(), bytes[1].data(), bytes[2].data(), bytes[3].data()};
+
+    const int paths[3] = {CITIROC_DECODER_SCALAR, CITIROC_DECODER_SSE2, CITIROC_DECODER_AVX2};
+    int nbErrors = 0;
+    for (int path: paths) {
+        if (path == CITIROC_DECODER_SCALAR) continue;
+        if (!CITIROC_setDecoderPath(path)) {
+            printf("%s: not available on this CPU\n", decodebench_pathName(path));
+            continue;
+        }
+        const int pathErrors = decodebench_check(path, fifo);
+        printf("%s: %s scalar output\n", decodebench_pathName(path), (pathErrors == 0) ? "same as" : "DIFFERENT from");
+        nbErrors += pathErrors;
+    }
+
+    printf("Decoding cycles of %d acquisitions (%d words):\n", nbAcqInCycle, nbAcqInCycle * CITIROC_WORDS_PER_ACQ);
+    CITIROC_cycleData cycle;
+    CITIROC_reserveCycle(&cycle, nbAcqInCycle);
+    for (int path: paths) {
+        if (!CITIROC_setDecoderPath(path)) continue;
+        unsigned long long nbWords = 0;
+        const auto start = std::chrono::steady_clock::now();
+        double elapsed = 0.;
+        while (elapsed < seconds) {
+            for (int j=0; j<100; j++) {
+                nbWords  += CITIROC_decodeCycle(fifo[0], fifo[1], fifo[2], fifo[3], nbAcqInCycle, &cycle);
+                decodebench_sink += cycle.hg[j % cycle.nbWords] + cycle.hit[cycle.nbWords - 1];
+            }
+            elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        printf("  %-6s %8.3g words/s\n", decodebench_pathName(path), nbWords / elapsed);
+    }
+    CITIROC_setDecoderPath(CITIROC_DECODER_AUTO);
+    return (nbErrors == 0) ? 0 : 1;
+}
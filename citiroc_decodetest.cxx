@@ -0,0 +1,104 @@
+/********************************************************************\
+Check CITIROC_decodeFIFOScalar against the former bit-string decoding.
+
+  citiroc_decodetest
+
+The FIFO bytes of a fixed set of words (all zeros, all ones,
+each bit alone, the start, hit and OTR bits alone and with a full ADC,
+then every 16-bit HG word) go through both:
+
+* the bit-string decoding of the former CITIROC_readFIFO:
+  each byte printed with sprintf, parsed back with strtol,
+  expanded with CITIROC_convertToBits, fifo21 then fifo20 (HG),
+  fifo24 then fifo23 (LG); ADC = first 12 bits, OTR = bit 12, hit = bit 13,
+  with the ADC bit string read as a binary number;
+* CITIROC_decodeFIFOScalar.
+
+ADC, OTR and hit must match for every word.
+Builds without MIDAS: make citiroc_decodetest.exe
+\********************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "CITIROC_decoder.h"
+
+// Copy of CITIROC_convertToBits (CITIROC.cxx), most significant bit first
+static void decodetest_convertToBits(int numberToConvert, const int numberOfBits, int* binary) {
+    for (int j=numberOfBits-1; j>=0; j--) {
+        if (numberToConvert <= 0) {binary[j] = 0;}
+        else {binary[j] = numberToConvert%2;}
+        numberToConvert = numberToConvert/2;
+    }
+}
+
+// Former decoding of one 16-bit word: high byte, then low byte
+static void decodetest_bitString(const unsigned char high, const unsigned char low, int* adc, int* otr, int* hit) {
+    const unsigned char bytes[2] = {high, low};
+    int bits[16];
+    for (int b=0; b<2; b++) {
+        char tempWord[16];
+        sprintf(tempWord, "0x%x", bytes[b]);
+        const long tempInt = strtol(tempWord, NULL, 16);
+        decodetest_convertToBits(tempInt, 8, &bits[8*b]);
+    }
+    char adcBits[13] = {0};
+    for (int j=0; j<12; j++) adcBits[j] = '0' + bits[j];
+    *adc = (int)strtol(adcBits, NULL, 2);
+    *otr = bits[12];
+    *hit = bits[13];
+}
+
+int main() {
+    // HG word (fifo21 << 8) | fifo20 and LG word (fifo24 << 8) | fifo23 of each test word
+    std::vector<uint16_t> wordsHG, wordsLG;
+    const uint16_t fixed[] = {
+        0x0000, 0xFFFF,
+        0x0001, 0x0004, 0x0008,   // start, hit, OTR alone
+        0xFFF1, 0xFFF4, 0xFFF8,   // with a full ADC
+        0xFFF0, 0x000F, 0x0010, 0x8000, 0x00FF, 0xFF00,
+    };
+    for (uint16_t word: fixed) {
+        wordsHG.push_back(word);
+        wordsLG.push_back(word);
+    }
+    for (int bit=0; bit<16; bit++) {
+        wordsHG.push_back((uint16_t)(1u << bit));
+        wordsLG.push_back((uint16_t)~(1u << bit));
+    }
+    for (uint32_t word=0; word<=0xFFFF; word++) {
+        wordsHG.push_back((uint16_t)word);
+        wordsLG.push_back((uint16_t)(0xFFFF - word));
+    }
+
+    const int nbWords = (int)wordsHG.size();
+    std::vector<unsigned char> fifo20(nbWords), fifo21(nbWords), fifo23(nbWords), fifo24(nbWords);
+    for (int j=0; j<nbWords; j++) {
+        fifo20[j] = wordsHG[j] & 0xFF;
+        fifo21[j] = wordsHG[j] >> 8;
+        fifo23[j] = wordsLG[j] & 0xFF;
+        fifo24[j] = wordsLG[j] >> 8;
+    }
+
+    std::vector<uint16_t> dataHG(nbWords), dataLG(nbWords);
+    std::vector<uint8_t>  hit(nbWords), otrHG(nbWords), otrLG(nbWords);
+    CITIROC_decodeFIFOScalar(fifo20.data(), fifo21.data(), fifo23.data(), fifo24.data(), nbWords,
+                             dataHG.data(), dataLG.data(), hit.data(), otrHG.data(), otrLG.data());
+
+    int nbErrors = 0;
+    for (int j=0; j<nbWords; j++) {
+        int adcHG, adcLG, otrBitHG, otrBitLG, hitBit, unused;
+        decodetest_bitString(fifo21[j], fifo20[j], &adcHG, &otrBitHG, &hitBit);
+        decodetest_bitString(fifo24[j], fifo23[j], &adcLG, &otrBitLG, &unused);
+        if (adcHG == dataHG[j] && adcLG == dataLG[j] && otrBitHG == otrHG[j] && otrBitLG == otrLG[j] && hitBit == hit[j]) continue;
+        if (nbErrors++ < 10) {
+            printf("Word %d (HG 0x%04x, LG 0x%04x): bit string ADC %d/%d OTR %d/%d hit %d, decoder ADC %d/%d OTR %d/%d hit %d\n",
+                   j, wordsHG[j], wordsLG[j], adcHG, adcLG, otrBitHG, otrBitLG, hitBit,
+                   dataHG[j], dataLG[j], otrHG[j], otrLG[j], hit[j]);
+        }
+    }
+    printf("%d words, %d mismatches\n", nbWords, nbErrors);
+    return (nbErrors == 0) ? 0 : 1;
+}
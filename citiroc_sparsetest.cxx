@@ -0,0 +1,98 @@
+/********************************************************************\
+Check the zero-suppressed format: encoding, expansion and bad words.
+
+  citiroc_sparsetest
+
+Cycles of random HG and LG values and hit masks, for 1 to 32 channels
+and 1 to 50 acquisitions, without thresholds, with thresholds on some
+channels, and with every channel hit, go through CITIROC_encodeSparse
+then CITIROC_expandSparse. Kept channels (hit, or HG above a threshold
+of their own) must come back with their HG, LG and hit bit, suppressed
+channels must read 0, the temperature sensor must come back in HG,
+and the bank must fit in nbAcq*(nbChannels+1) words.
+Inconsistent banks (more channels than the cycle has, a count past the
+end of the bank, a channel number out of range) must return -1.
+Builds without MIDAS: make citiroc_sparsetest.exe
+\********************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <vector>
+#include "CITIROC_sparse.h"
+
+#define SPARSETEST_NO_THRESHOLD 0
+#define SPARSETEST_THRESHOLDS   1
+#define SPARSETEST_ALL_HIT      2
+
+static uint32_t sparsetest_random32() {
+    return ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+}
+
+static bool sparsetest_roundTrip(const int kind, const int nbAcq, const int nbChannels) {
+    const int stride = nbChannels + 1;
+    std::vector<uint16_t> hg(nbAcq * stride), lg(nbAcq * stride), hgOut(nbAcq * stride), lgOut(nbAcq * stride);
+    std::vector<uint32_t> hits(nbAcq), hitsOut(nbAcq), sparse(nbAcq * stride);
+    std::vector<int> thresholds(nbChannels, 0);
+    if (kind == SPARSETEST_THRESHOLDS) {
+        for (int chn=0; chn<nbChannels; chn+=3) thresholds[chn] = 1000 + rand() % 2000;
+    }
+    for (int acq=0; acq<nbAcq; acq++) {
+        for (int j=0; j<stride; j++) {
+            hg[acq*stride + j] = rand() & 0x0FFF;
+            lg[acq*stride + j] = rand() & 0x0FFF;
+        }
+        const uint32_t all = (nbChannels == 32) ? 0xFFFFFFFFu : ((1u << nbChannels) - 1);
+        // About one channel in four hit
+        hits[acq] = (kind == SPARSETEST_ALL_HIT) ? all : sparsetest_random32() & sparsetest_random32() & all;
+    }
+
+    const int* usedThresholds = (kind == SPARSETEST_THRESHOLDS) ? thresholds.data() : NULL;
+    const int nbSparse = CITIROC_encodeSparse(hg.data(), lg.data(), hits.data(), nbAcq, nbChannels, usedThresholds, sparse.data());
+    if (nbSparse < nbAcq || nbSparse > nbAcq * stride) return false;
+    if (CITIROC_expandSparse(sparse.data(), nbSparse, nbChannels, hgOut.data(), lgOut.data(), hitsOut.data()) != nbAcq) return false;
+
+    for (int acq=0; acq<nbAcq; acq++) {
+        if (hitsOut[acq] != hits[acq]) return false;
+        for (int chn=0; chn<nbChannels; chn++) {
+            const int j = acq*stride + chn;
+            const bool kept = ((hits[acq] >> chn) & 1) || (thresholds[chn] > 0 && hg[j] > thresholds[chn]);
+            if (hgOut[j] != (kept ? hg[j] : 0) || lgOut[j] != (kept ? lg[j] : 0)) return false;
+        }
+        if (hgOut[acq*stride + nbChannels] != hg[acq*stride + nbChannels] || lgOut[acq*stride + nbChannels] != 0) return false;
+    }
+    return true;
+}
+
+static int sparsetest_expectInconsistent(const char* name, const std::vector<uint32_t>& sparse, const int nbChannels) {
+    std::vector<uint16_t> hg(64 * (nbChannels + 1)), lg(64 * (nbChannels + 1));
+    std::vector<uint32_t> hits(64);
+    const int status = CITIROC_expandSparse(sparse.data(), sparse.size(), nbChannels, hg.data(), lg.data(), hits.data());
+    printf("%-40s %s\n", name, (status == -1) ? "OK" : "FAILED");
+    return (status == -1) ? 0 : 1;
+}
+
+int main() {
+    int nbErrors = 0;
+    srand(12345);
+
+    const char* kinds[3] = {"no threshold", "thresholds", "every channel hit"};
+    for (int kind=SPARSETEST_NO_THRESHOLD; kind<=SPARSETEST_ALL_HIT; kind++) {
+        int nbFailed = 0;
+        for (int nbChannels=1; nbChannels<=32; nbChannels++) {
+            for (int nbAcq=1; nbAcq<=50; nbAcq++) {
+                if (!sparsetest_roundTrip(kind, nbAcq, nbChannels)) nbFailed++;
+            }
+        }
+        printf("%-40s %4d of %d round trips failed\n", kinds[kind], nbFailed, 32 * 50);
+        nbErrors += nbFailed;
+    }
+
+    // Acquisition header, then one word of channel 3
+    const uint32_t channel3 = (1u << CITIROC_SPARSE_HIT_SHIFT) | (3u << CITIROC_SPARSE_CHN_SHIFT) | 100;
+    nbErrors += sparsetest_expectInconsistent("count above the number of channels", {33, channel3}, 32);
+    nbErrors += sparsetest_expectInconsistent("count past the end of the bank", {2, channel3}, 32);
+    nbErrors += sparsetest_expectInconsistent("channel out of range", {1, channel3}, 3);
+
+    return (nbErrors == 0) ? 0 : 1;
+}
@@ -0,0 +1,104 @@
+/********************************************************************\
+Decompress and verify the C1CZ banks of a MIDAS file written by fecitiroc.
+
+  citiroc_unpack <run.mid[.gz]> [out.csv]
+
+Each compressed cycle is restored with CITIROC_decompressCycle,
+checked against its CRC-32, and optionally decoded into a CSV file
+with the layout of the side-channel writer
+(cycle, acquisition, hit mask, 33 HG values, 33 LG values).
+Builds without MIDAS: make citiroc_unpack.exe
+\********************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <zlib.h>
+#include "CITIROC_compress.h"
+#include "CITIROC_decoder.h"
+
+// MIDAS event and bank headers, see midas.h
+struct unpack_eventHeader {
+    int16_t  eventID;
+    int16_t  triggerMask;
+    uint32_t serialNumber;
+    uint32_t timeStamp;
+    uint32_t dataSize;
+};
+struct unpack_bankHeader {
+    uint32_t dataSize;
+    uint32_t flags;
+};
+#define UNPACK_BANK_32BIT       (1 << 4)
+#define UNPACK_BANK_64BIT_ALIGN (1 << 5)
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        printf("Usage: %s <run.mid[.gz]> [out.csv]\n", argv[0]);
+        return 1;
+    }
+    gzFile file = gzopen(argv[1], "rb");
+    if (file == NULL) {printf("Unable to open %s\n", argv[1]); return 1;}
+    FILE* csv = (argc > 2) ? fopen(argv[2], "w") : NULL;
+    if (argc > 2 && csv == NULL) {printf("Unable to open %s\n", argv[2]); return 1;}
+
+    std::vector<unsigned char> event;
+    std::vector<unsigned char> fifo[4];
+    CITIROC_cycleData cycle;
+    unsigned long long nbCycles = 0, nbCorrupted = 0, nbRaw = 0, nbCompressed = 0;
+
+    unpack_eventHeader header;
+    while (gzread(file, &header, sizeof(header)) == sizeof(header)) {
+        event.resize(header.dataSize);
+        if (gzread(file, event.data(), header.dataSize) != (int)header.dataSize) break;
+        // Begin-of-run, end-of-run and message events carry no banks
+        if ((header.eventID & 0xFFFF) >= 0x8000 || header.dataSize < sizeof(unpack_bankHeader)) continue;
+
+        unpack_bankHeader bankHeader;
+        memcpy(&bankHeader, event.data(), sizeof(bankHeader));
+        const bool is32  = bankHeader.flags & UNPACK_BANK_32BIT;
+        const bool is64  = bankHeader.flags & UNPACK_BANK_64BIT_ALIGN;
+        const size_t nbHeader = is32 ? (is64 ? 16 : 12) : 8;
+        size_t position = sizeof(bankHeader);
+        const size_t end = sizeof(bankHeader) + bankHeader.dataSize;
+
+        while (position + nbHeader <= end && end <= event.size()) {
+            const unsigned char* bank = event.data() + position;
+            uint32_t size;
+            if (is32) {memcpy(&size, bank + 8, 4);}
+            else      {uint16_t size16; memcpy(&size16, bank + 6, 2); size = size16;}
+            if (memcmp(bank, "C1CZ", 4) == 0) {
+                const int nbAcq = CITIROC_decompressCycle(bank + nbHeader, size, fifo);
+                nbCycles++;
+                nbCompressed += size;
+                if (nbAcq < 0) {
+                    nbCorrupted++;
+                    printf("Event %u: corrupted C1CZ bank\n", header.serialNumber);
+                } else {
+                    nbRaw += 4 * nbAcq * CITIROC_WORDS_PER_ACQ;
+                    if (csv != NULL) {
+                        CITIROC_decodeCycle(fifo[0].data(), fifo[1].data(), fifo[2].data(), fifo[3].data(), nbAcq, &cycle);
+                        for (int acq=0; acq<nbAcq; acq++) {
+                            uint32_t mask = 0;
+                            for (int chn=0; chn<CITIROC_NB_CHANNELS; chn++) {
+                                mask |= (uint32_t)cycle.hit[acq*CITIROC_WORDS_PER_ACQ + chn] << chn;
+                            }
+                            fprintf(csv, "%u,%d,0x%08x", header.serialNumber, acq, mask);
+                            for (int chn=0; chn<CITIROC_WORDS_PER_ACQ; chn++) fprintf(csv, ",%u", cycle.hg[acq*CITIROC_WORDS_PER_ACQ + chn]);
+                            for (int chn=0; chn<CITIROC_WORDS_PER_ACQ; chn++) fprintf(csv, ",%u", cycle.lg[acq*CITIROC_WORDS_PER_ACQ + chn]);
+                            fputc('\n', csv);
+                        }
+                    }
+                }
+            }
+            position += nbHeader + ((size + 7) & ~(size_t)7);
+        }
+    }
+    gzclose(file);
+    if (csv != NULL) fclose(csv);
+
+    printf("%llu compressed cycles, %llu corrupted, %llu bytes restored from %llu (ratio %.2f)\n",
+           nbCycles, nbCorrupted, nbRaw, nbCompressed, nbCompressed > 0 ? (double)nbRaw / nbCompressed : 0.);
+    return nbCorrupted > 0 ? 2 : 0;
+}
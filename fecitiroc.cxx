@@ -11,6 +11,7 @@ L. Koerich, Nov 2022
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <chrono>
 #include "odbxx.h"
 
 #include "midas.h"
@@ -22,8 +23,14 @@ L. Koerich, Nov 2022
 
 #include "OdbDT5743.h"
 
+#ifndef CITIROC_NO_HARDWARE
+#define CAEN_USE_DIGITIZERS
+#endif
+
 // CAEN includes
+#ifdef CAEN_USE_DIGITIZERS
 #include <CAENDigitizer.h>
+#endif
 
 #include "CITIROC.h"
 
@@ -31,13 +38,34 @@ L. Koerich, Nov 2022
 #define  EQ_EVID   1
 #define  EQ_TRGMSK 0x1111
 
-#define CAEN_USE_DIGITIZERS
-
 /* Globals */
 #define N_DT5743 1
+#define CITIROC_MAX_BOARDS 8
 bool CITIROC_status;
-int CITIROC_usbID;
-const char* CITIROC_serialNumber = "CT1A_31A";
+CITIROC_geometry CITIROC_runGeometry;   // read from ODB at the start of each run
+const int CITIROC_ringSize      = 4;   // cycles buffered between acquisition thread and readout
+const int CITIROC_flushTimeoutMs = 5000;  // longest wait for the readout to empty the rings at a stop or pause
+
+// One CITIROC1A board, from "Board serial numbers" at ODB.
+// Each board has its own acquisition thread and per-run state;
+// the ASIC, firmware and DAQ settings are common to all of them.
+struct CITIROC_board {
+  std::string serialNumber;
+  int usbID = 0;
+  CITIROC_acquisition acq;
+  CITIROC_writer sideWriter;     // optional per-run file of decoded cycles
+  CITIROC_histograms spectra;    // per-run spectra, filled by read_trigger_event
+  CITIROC_pedestals pedestalTable; // per-run pedestals, updated by read_trigger_event
+  CITIROC_statistics statistics; // per-run throughput and errors, updated by read_slow_event
+  midas::odb* statisticsOdb = NULL; // Statistics/<serial number>, see initialize_statistics
+};
+CITIROC_board CITIROC_boards[CITIROC_MAX_BOARDS];
+int CITIROC_nbBoards = 0;
+
+// Events merged from the cycles of all boards, see poll_event
+CITIROC_builder CITIROC_eventBuilder;
+CITIROC_builtEvent CITIROC_nextEvent;  // built by poll_event, banked by read_trigger_event
+bool CITIROC_eventReady = false;
 
 /* Hardware */
 extern HNDLE hDB;
@@ -45,14 +73,27 @@ extern BOOL debug;
 
 HNDLE hSet[N_DT5743];
 DT5743_CONFIG_SETTINGS tsvc[N_DT5743];
-const char BankName[N_DT5743][5]={"D743"};
-const char BankNameHG[N_DT5743][6]={"WC1AHG"};
-const char BankNameLG[N_DT5743][6]={"WC1ALG"};
 const char BankNameSlow[N_DT5743][5]={"43SL"};
+const char BankNameBuilder[5]="CBHD";
+const char BankNameBuilderStats[5]="CBST";
+// Board b writes C<b+1>xx banks, see name_banks
+char BankNameHeader[CITIROC_MAX_BOARDS][5];
+char BankNameHG[CITIROC_MAX_BOARDS][5];
+char BankNameLG[CITIROC_MAX_BOARDS][5];
+char BankNameHits[CITIROC_MAX_BOARDS][5];
+char BankNameRegisters[CITIROC_MAX_BOARDS][5];
+char BankNameScan[CITIROC_MAX_BOARDS][5];
+char BankNameSpectraHG[CITIROC_MAX_BOARDS][5];
+char BankNameSpectraLG[CITIROC_MAX_BOARDS][5];
+char BankNameHitCounts[CITIROC_MAX_BOARDS][5];
+char BankNameSparse[CITIROC_MAX_BOARDS][5];
+char BankNamePedestals[CITIROC_MAX_BOARDS][5];
+char BankNameCompressed[CITIROC_MAX_BOARDS][5];
+char BankNameLatency[CITIROC_MAX_BOARDS][5];
+char BankNameStatistics[CITIROC_MAX_BOARDS][5];
+char BankNameCounters[CITIROC_MAX_BOARDS][5];
 // const char BankNameSlow[N_DT5743][6]={"WC1AL"};
 
-// extern int CITIROC_usbID;
-
 // VMEIO definition
 
 /* make frontend functions callable from the C framework */
@@ -85,9 +126,6 @@ int   dt5743_handle[N_DT5743];
 int  linRun = 0;
 int  done=0, stop_req=0;
 
-// handle to CAEN digitizer;
-int handle;
-
 //time_t rawtime;
 //struct tm *timeinfo;
 struct timeval te;
@@ -100,13 +138,17 @@ INT begin_of_run(INT run_number, char *error);
 INT end_of_run(INT run_number, char *error);
 INT pause_run(INT run_number, char *error);
 INT resume_run(INT run_number, char *error);
+BOOL flush_boards(INT transition, BOOL first);
 INT frontend_loop();
 extern void interrupt_routine(void);
 INT read_trigger_event(char *pevent, INT off);
 INT read_slow_event(char *pevent, INT off);
+INT read_histogram_event(char *pevent, INT off);
 INT initialize_slow_control();
 INT initialize_daq_parameters();
 INT initialize_HV_parameters();
+INT initialize_statistics(const int b);
+void name_banks();
 
 /*-- Equipment list ------------------------------------------------*/
 #undef USE_INT
@@ -141,11 +183,28 @@ EQUIPMENT equipment[] = {
       500,                    /* poll for 500ms */
       0,                      /* stop run after this event limit */
       0,                      /* number of sub events */
-      0,                      /* don't log history */
+      10,                     /* log history every 10 s */
       "", "", "",
     },
     read_slow_event,       /* readout routine */
   },
+  { "Citiroc1A_Histograms",            /* equipment name */
+    {
+      EQ_EVID, EQ_TRGMSK,     /* event ID, trigger mask */
+      "SYSTEM",              /* event buffer */
+      EQ_PERIODIC ,      /* equipment type */
+      LAM_SOURCE(0, 0x8111),     /* event source crate 0, all stations */
+      "MIDAS",                /* format */
+      TRUE,                   /* enabled */
+      RO_RUNNING | RO_EOR,    /* read when running and at end of run */
+      10000,                  /* publish every 10 s */
+      0,                      /* stop run after this event limit */
+      0,                      /* number of sub events */
+      0,                      /* don't log history */
+      "", "", "",
+    },
+    read_histogram_event,  /* readout routine */
+  },
   {""}
 };
 
@@ -463,10 +522,47 @@ extern INT initialize_daq_parameters() {
     {"DAC 03", 0},
     {"DAC 04", 0},
     {"LALUsb verbosity", true},
+    {"Board serial numbers", std::array<std::string, CITIROC_MAX_BOARDS>{"CT1A_31A"}},
+    {"Event building (0 off, 1 cycle number, 2 host time)", 0},
+    {"Event-building window (cycles or us)", 0},
+    {"Event-building timeout (ms)", 100},
+    {"Polling (0 blocking read, 1 adaptive)", 1},
+    {"Polling sleep fraction", 0.8},
+    {"Polling spin polls", 20},
+    {"Polling yield polls", 50},
+    {"Polling sleep (us)", 20},
+    {"Free running", false},
     {"FIFO write size", 8192},
     {"FIFO read size", 32768},
     {"Read time out (1-255 ms)", 200},
     {"Write time out (1-255 ms)", 200},
+    {"Use emulator", false},
+    {"Emulator trigger rate (Hz)", 1000.0},
+    {"Emulator hit probability", 0.1},
+    {"Emulator USB latency (us)", 0},
+    {"Emulator restart probability", 0.0},
+    {"Register audit period (s)", 60},
+    {"Acquisitions per cycle", 100},
+    {"Acquisitions per run", 0},
+    {"Channels", 32},
+    {"Max FIFO depth", false},
+    {"Side-channel format (0 off, 1 binary, 2 CSV)", 0},
+    {"Side-channel directory", "~/online"},
+    {"Side-channel queue (cycles)", 64},
+    {"Online histograms", true},
+    {"Zero suppression", false},
+    {"Zero-suppression HG thresholds", std::array<int, 32>{}},
+    {"Zero-suppression pedestal sigmas", 0.0},
+    {"Pedestal tracking", true},
+    {"Pedestal subtraction", false},
+    {"Compression codec (0 off, 1 pack, 2 zlib)", 0},
+    {"Compression level (zlib 1-9)", 1},
+    {"Scan parameter", ""},
+    {"Scan channel (-1 all)", -1},
+    {"Scan start", 0},
+    {"Scan stop", 0},
+    {"Scan step", 1},
+    {"Scan acquisitions per point", 1000},
   };
 
   // Add parameters to ODB
@@ -509,6 +605,73 @@ extern INT initialize_HV_parameters() {
 
 }
 
+extern INT initialize_statistics(const int b) {
+
+  // Statistics of board b, rewritten by read_slow_event
+  CITIROC_board& board = CITIROC_boards[b];
+  if (board.statisticsOdb == NULL) board.statisticsOdb = new midas::odb({
+    {"Cycles/s", 0.0},
+    {"Acquisitions/s", 0.0},
+    {"FIFO 20 bytes/s", 0.0},
+    {"FIFO 21 bytes/s", 0.0},
+    {"FIFO 23 bytes/s", 0.0},
+    {"FIFO 24 bytes/s", 0.0},
+    {"Mean cycle latency (us)", 0.0},
+    {"P99 cycle latency (us)", 0.0},
+    {"Status polls/cycle", 0.0},
+    {"Expected fill time (us)", 0.0},
+    {"Live fraction", 0.0},
+    {"Live time (s)", 0.0},
+    {"Dead time (s)", 0.0},
+    {"Cycles", 0},
+    {"Acquisitions", 0},
+    {"Restarts (subaddress 22)", 0},
+    {"Timeouts", 0},
+    {"Short reads", 0},
+    {"Full ring", 0},
+    {"USB errors", 0},
+    {"Arming USB errors", 0},
+    {"Status polls", 0},
+    {"Dropped cycles", 0},
+  });
+
+  // Add parameters to ODB
+  board.statisticsOdb->connect(std::string(odbdir_statistics) + "/" + board.serialNumber);
+
+  // Catch error
+  int ret = board.statisticsOdb->is_connected_odb();
+  if (ret > 0) {
+    return ret;
+  } else {
+    printf("Unable to connect with statistics ODB. Ret: %d.\n", ret);
+  }
+  return ret;
+}
+
+/*-- Bank names ----------------------------------------------------*/
+void name_banks()
+{
+  // C1xx for the first board, as with a single board, C2xx for the second...
+  for (int b=0; b<CITIROC_MAX_BOARDS; b++) {
+    const char id = '1' + b;
+    sprintf(BankNameHeader[b],     "C%cHD", id);
+    sprintf(BankNameHG[b],         "C%cHG", id);
+    sprintf(BankNameLG[b],         "C%cLG", id);
+    sprintf(BankNameHits[b],       "C%cHT", id);
+    sprintf(BankNameRegisters[b],  "C%cRG", id);
+    sprintf(BankNameScan[b],       "C%cSC", id);
+    sprintf(BankNameSpectraHG[b],  "C%cHH", id);
+    sprintf(BankNameSpectraLG[b],  "C%cLH", id);
+    sprintf(BankNameHitCounts[b],  "C%cHC", id);
+    sprintf(BankNameSparse[b],     "C%cZS", id);
+    sprintf(BankNamePedestals[b],  "C%cPD", id);
+    sprintf(BankNameCompressed[b], "C%cCZ", id);
+    sprintf(BankNameLatency[b],    "C%cLT", id);
+    sprintf(BankNameStatistics[b], "C%cST", id);
+    sprintf(BankNameCounters[b],   "C%cCT", id);
+  }
+}
+
 /********************************************************************\
               Callback routines for system transitions
 
@@ -552,12 +715,25 @@ void seq_callback(INT hDB, INT hseq, void *info)
 
 INT initialize_for_run();
 
+/*-- ODB settings changed ------------------------------------------*/
+void config_changed()
+{
+  // The acquisition threads bring their board up to date between two
+  // cycles, or when they restart after a pause; between runs,
+  // initialize_for_run sends the settings and drops the request.
+  for (int b=0; b<CITIROC_nbBoards; b++) {
+    CITIROC_requestReconfiguration(&CITIROC_boards[b].acq);
+  }
+}
+
 /*-- Frontend Init -------------------------------------------------*/
 INT frontend_init()
 {
   int size, status;
   char set_str[80];
+#ifdef CAEN_USE_DIGITIZERS
   CAEN_DGTZ_BoardInfo_t       BoardInfo;
+#endif
   
   // Testing odbxx 
   initialize_slow_control();
@@ -578,23 +754,59 @@ INT frontend_init()
   status = db_find_key (hDB, 0, set_str, &hSet[0]);
   if (status != DB_SUCCESS) cm_msg(MINFO,"FE","Key %s not found", set_str);
 
-  // Open communication and initialize board
-  printf("Opening communication...\n");
-  CITIROC_usbID = CITIROC_connect(CITIROC_serialNumber);
+  // Settings are read from ODB once, then only when ODB changes
+  CITIROC_loadConfig();
+  CITIROC_watchConfig(config_changed);
+  std::shared_ptr<const CITIROC_config> config = CITIROC_getConfig();
+
+  // Select the board or its software emulator
+  bool useEmulator = config->useEmulator;
+#ifdef CITIROC_NO_HARDWARE
+  useEmulator = true;
+#endif
+  if (useEmulator) {
+    CITIROC_emulatorConfigure(config->emulator);
+    CITIROC_setTransport(&CITIROC_transportEmulator);
+  }
 
-  if (CITIROC_usbID < 1) {
-    cm_msg(MERROR, "frontend_init", "Invalid usb ID. Unable to open CITIROC board");
+  // Open communication and initialize each board
+  name_banks();
+  CITIROC_nbBoards = 0;
+  if (config->serialNumbers.empty()) {
+    cm_msg(MERROR, "frontend_init", "No board serial number in %s/Board serial numbers", odbdir_DAQ);
     return -1;
-  } else {
-    cm_msg(MINFO, "frontend_init", "Connected to CITIROC board of serial no. %s with usb ID: %d", CITIROC_serialNumber, CITIROC_usbID);
   }
-  
-  CITIROC_status = CITIROC_initialize(CITIROC_usbID);
-  if (CITIROC_status != true) {
-    cm_msg(MERROR, "initialize_for_run", "Unable to initialize CITIROC board.");
-    return -1;
+  if (config->serialNumbers.size() > CITIROC_MAX_BOARDS) {
+    cm_msg(MERROR, "frontend_init", "%d boards at most, ignoring the other serial numbers", CITIROC_MAX_BOARDS);
+  }
+  printf("Opening communication...\n");
+  for (const std::string& serialNumber: config->serialNumbers) {
+    if (CITIROC_nbBoards == CITIROC_MAX_BOARDS) break;
+    CITIROC_board& board = CITIROC_boards[CITIROC_nbBoards];
+    board.serialNumber = serialNumber;
+    board.usbID = CITIROC_connect((char*)board.serialNumber.c_str());
+
+    if (board.usbID < 1) {
+      cm_msg(MERROR, "frontend_init", "Invalid usb ID. Unable to open CITIROC board of serial no. %s", board.serialNumber.c_str());
+      return -1;
+    } else {
+      cm_msg(MINFO, "frontend_init", "Connected to CITIROC board of serial no. %s with usb ID: %d (banks %.2sxx)",
+             board.serialNumber.c_str(), board.usbID, BankNameHeader[CITIROC_nbBoards]);
+    }
+    CITIROC_nbBoards++;
+    initialize_statistics(CITIROC_nbBoards - 1);
+
+    CITIROC_status = CITIROC_initialize(board.usbID);
+    if (CITIROC_status != true) {
+      cm_msg(MERROR, "frontend_init", "Unable to initialize CITIROC board of serial no. %s.", board.serialNumber.c_str());
+      return -1;
+    }
   }
 
+  // Bank the cycles still queued before stopping or pausing
+  cm_register_deferred_transition(TR_STOP, flush_boards);
+  cm_register_deferred_transition(TR_PAUSE, flush_boards);
+
   // If a run is going, start the digitizer running
   int state = 0; 
   size = sizeof(state); 
@@ -618,14 +830,17 @@ INT frontend_exit()
 {
 
   printf("Closing communication and exiting frontend...\n");
-  CITIROC_status = CITIROC_disconnet(CITIROC_usbID);
+  for (int b=0; b<CITIROC_nbBoards; b++) {
+    CITIROC_stopAcquisition(&CITIROC_boards[b].acq);
+    CITIROC_stopWriter(&CITIROC_boards[b].sideWriter);
+    CITIROC_status = CITIROC_disconnet(CITIROC_boards[b].usbID);
+  }
+  CITIROC_nbBoards = 0;
 
   printf("End of exit\n");
   return SUCCESS;
 }
 
-char *gBuffer = NULL;
-
 INT initialize_for_run(){
   
   printf("Initializing board for running\n");
@@ -638,19 +853,65 @@ INT initialize_for_run(){
   //   return -1;
   // }
 
-  CITIROC_status = CITIROC_sendASIC(CITIROC_usbID);
-  if (CITIROC_status == false) {
-    cm_msg(MERROR, "initialize_for_run", "Unable to send ASIC string to board.");
-    CITIROC_raiseException();
+  // Size the buffers of the run once, from the geometry at ODB
+  if (!CITIROC_getGeometry(&CITIROC_runGeometry)) {
+    cm_msg(MINFO, "initialize_for_run", "Acquisition geometry out of range, using %d acquisitions per cycle and %d channels.",
+           CITIROC_runGeometry.nbAcqInCycle, CITIROC_runGeometry.nbChannels);
   }
+  std::shared_ptr<const CITIROC_config> config = CITIROC_getConfig();
+
+  for (int b=0; b<CITIROC_nbBoards; b++) {
+    CITIROC_board& board = CITIROC_boards[b];
+
+    // Counters, live time and pending reconfiguration of the run;
+    // resume_run carries on with them
+    CITIROC_resetAcquisition(&board.acq);
+
+    // ASIC and firmware settings; skipped if the board already holds them
+    CITIROC_status = CITIROC_sendConfiguration(board.usbID);
+    if (CITIROC_status == false) {
+      cm_msg(MERROR, "initialize_for_run", "Unable to send ASIC and firmware settings to board %s.", board.serialNumber.c_str());
+      CITIROC_raiseException();
+    }
+
+    // Spectra of the run, published by read_histogram_event
+    CITIROC_histogramsReset(&board.spectra, CITIROC_runGeometry.nbChannels);
+
+    // Pedestals of the run, published by read_slow_event
+    CITIROC_pedestalsReset(&board.pedestalTable, CITIROC_runGeometry.nbChannels);
+
+    // Throughput and errors of the run, published by read_slow_event
+    CITIROC_statisticsReset(&board.statistics);
+
+    // Optional threshold/DAC scan, stepped by the acquisition thread
+    if (!CITIROC_scanConfigure(&board.acq.scan, *config)) {
+      cm_msg(MERROR, "initialize_for_run", "Invalid scan settings, taking data without scan.");
+    }
 
-  CITIROC_status = CITIROC_sendFirmwareSettings(CITIROC_usbID);
-  if (CITIROC_status == false) {
-    cm_msg(MERROR, "initialize_for_run", "Unable to send firmware settings after ASIC.");
-    CITIROC_raiseException();
+    // Optional compression of the raw cycles, off the readout thread
+    board.acq.codec = config->compressionCodec;
+    board.acq.level = config->compressionLevel;
+
+    // Wait for the end of each cycle; the fill time is learnt again each run
+    CITIROC_pollerReset(&board.acq.poller, config->polling);
+    board.acq.freeRunning = config->freeRunning;
+
+    // Keep the board acquiring while MIDAS builds events
+    if (!CITIROC_startAcquisition(&board.acq, board.usbID, CITIROC_runGeometry, CITIROC_ringSize)) {
+      cm_msg(MERROR, "initialize_for_run", "Unable to start acquisition thread of board %s.", board.serialNumber.c_str());
+      return -1;
+    }
   }
 
-  int module = 0, status;
+  // Merge the cycles of the boards into events
+  CITIROC_acquisition* acquisitions[CITIROC_MAX_BOARDS];
+  for (int b=0; b<CITIROC_nbBoards; b++) acquisitions[b] = &CITIROC_boards[b].acq;
+  CITIROC_eventReady = false;
+  if (!CITIROC_builderReset(&CITIROC_eventBuilder, acquisitions, CITIROC_nbBoards,
+                            config->buildMode, config->buildWindow, 1000LL * config->buildTimeout)) {
+    cm_msg(MERROR, "initialize_for_run", "Invalid event-building settings, taking the next cycle of each board.");
+    CITIROC_builderReset(&CITIROC_eventBuilder, acquisitions, CITIROC_nbBoards, CITIROC_BUILD_OFF, 0, 0);
+  }
     
   return ret;
 }
@@ -663,6 +924,15 @@ INT begin_of_run(INT run_number, char *error)
   // Update values 
   initialize_for_run();
 
+  // Optional copy of the decoded cycles, written off the readout thread
+  std::shared_ptr<const CITIROC_config> config = CITIROC_getConfig();
+  for (int b=0; b<CITIROC_nbBoards && config->sideFormat != CITIROC_WRITER_OFF; b++) {
+    if (!CITIROC_startWriter(&CITIROC_boards[b].sideWriter, config->sideDirectory.c_str(), run_number, b,
+                             config->sideFormat, config->sideQueue, CITIROC_runGeometry)) {
+      cm_msg(MERROR, "begin_of_run", "Unable to start side-channel writer in %s.", config->sideDirectory.c_str());
+    }
+  }
+
   //------ FINAL ACTIONS before BOR -----------
   printf("End of BOR\n");
   //sprintf(stastr,"GrpEn:0x%x", tsvc[0].group_mask); 
@@ -675,6 +945,25 @@ INT end_of_run(INT run_number, char *error)
 {
 
   printf("EOR\n");
+  for (int b=0; b<CITIROC_nbBoards; b++) {
+    CITIROC_board& board = CITIROC_boards[b];
+    CITIROC_stopAcquisition(&board.acq);
+    CITIROC_stopWriter(&board.sideWriter);
+
+    // Cycles flush_boards could not bank in time
+    CITIROC_eventReady = false;
+    CITIROC_discardCycles(&board.acq);
+    if (board.acq.droppedCycles > 0) {
+      cm_msg(MERROR, "end_of_run", "Run %d, board %s: %u cycles dropped at stop or pause.", run_number,
+             board.serialNumber.c_str(), board.acq.droppedCycles.load());
+    }
+
+    // Live time of the run, to quote with the data
+    const double runTime  = 1e-9 * CITIROC_runTime(&board.acq);
+    const double liveTime = 1e-9 * board.acq.liveTime.load();
+    cm_msg(MINFO, "end_of_run", "Run %d, board %s: live %.3f s of %.3f s (%.2f%%).", run_number,
+           board.serialNumber.c_str(), liveTime, runTime, (runTime > 0.) ? 100. * liveTime / runTime : 0.);
+  }
 
 	// Stop acquisition
 	// CAEN_DGTZ_SWStopAcquisition(handle);
@@ -686,6 +975,16 @@ INT end_of_run(INT run_number, char *error)
 INT pause_run(INT run_number, char *error)
 {
   linRun = 0;
+  CITIROC_eventReady = false;
+  for (int b=0; b<CITIROC_nbBoards; b++) {
+    CITIROC_board& board = CITIROC_boards[b];
+    CITIROC_stopAcquisition(&board.acq);
+    // Cycles flush_boards could not bank in time; the ring starts over at resume
+    const uint32_t dropped = CITIROC_discardCycles(&board.acq);
+    if (dropped > 0) {
+      cm_msg(MERROR, "pause_run", "Run %d, board %s: %u cycles dropped at pause.", run_number, board.serialNumber.c_str(), dropped);
+    }
+  }
   return SUCCESS;
 }
 
@@ -693,9 +992,41 @@ INT pause_run(INT run_number, char *error)
 INT resume_run(INT run_number, char *error)
 {
   linRun = 1;
+  // Same counters, cycle numbers and live time as before the pause;
+  // settings changed during the pause are sent before the first cycle
+  for (int b=0; b<CITIROC_nbBoards; b++) {
+    CITIROC_board& board = CITIROC_boards[b];
+    if (!CITIROC_startAcquisition(&board.acq, board.usbID, CITIROC_runGeometry, CITIROC_ringSize)) {
+      cm_msg(MERROR, "resume_run", "Unable to restart acquisition thread of board %s.", board.serialNumber.c_str());
+      return -1;
+    }
+  }
   return SUCCESS;
 }
 
+/*-- Deferred Stop and Pause ---------------------------------------*/
+BOOL flush_boards(INT transition, BOOL first)
+{
+  /* Called until it returns TRUE before end_of_run and pause_run.
+     The acquisition threads are stopped at the first call, then the
+     run stays on while read_trigger_event banks the cycles left in
+     the rings, for CITIROC_flushTimeoutMs at most. */
+  static DWORD flushStart = 0;
+
+  if (first) {
+    for (int b=0; b<CITIROC_nbBoards; b++) CITIROC_stopAcquisition(&CITIROC_boards[b].acq);
+    flushStart = ss_millitime();
+  }
+  bool empty = !CITIROC_eventReady;
+  for (int b=0; b<CITIROC_nbBoards; b++) empty &= CITIROC_boards[b].acq.ring.empty();
+  if (empty) return TRUE;
+  if (ss_millitime() - flushStart > (DWORD)CITIROC_flushTimeoutMs) {
+    cm_msg(MINFO, "flush_boards", "Cycles still queued after %d ms, dropping them.", CITIROC_flushTimeoutMs);
+    return TRUE;
+  }
+  return FALSE;
+}
+
 /*-- Frontend Loop -------------------------------------------------*/
 INT frontend_loop()
 {
@@ -734,12 +1065,14 @@ int Nloop, Ncount;
 
   for (i = 0; i < count; i++) {
     
-    // Read register 4. If "0000001", DAQ is over and FIFO can be read.
-    std::string word4;
-    CITIROC_status = CITIROC_readString(CITIROC_usbID, 4, &word4);
-    if(word4.compare(std::string("00000001"))) lam = 1;
+    // The acquisition threads queue complete cycles; no USB traffic here.
+    if (!CITIROC_eventReady) {
+      const long long now = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+      CITIROC_eventReady = CITIROC_builderNext(&CITIROC_eventBuilder, now, &CITIROC_nextEvent);
+    }
+    lam = CITIROC_eventReady;
+    if (!lam) ss_sleep(1);
     
-    ss_sleep(1);
     if (lam) {
       Nloop = i; Ncount = count;
       if (!test){
@@ -769,64 +1102,183 @@ int Nloop, Ncount;
 /*-- Event readout -------------------------------------------------*/
 int vf48_error = 0;
 #include <stdint.h>
-INT read_trigger_event(char *pevent, INT off)
+static void write_board_banks(char *pevent, const int b, const CITIROC_rawCycle* cycle,
+                              const std::shared_ptr<const CITIROC_config>& config)
+/* Banks of one cycle of board b */
 {
-   // Get number of events in buffer
-   uint32_t buffsize;
-   uint32_t numEvents;    
-	
-  int* dataHG, dataLG, hits;
-  int fifoSize = 0;
-  printf("Attempt to read trigger event.\n");
-  printf("Run number: %i\n", run_number);
-  fifoSize = CITIROC_readFIFO(CITIROC_usbID, dataHG, dataLG, hits, run_number);
-
-   if(CITIROC_status <= 0){
-      printf("Failed to read data,\n");
-   }
+   CITIROC_board& board = CITIROC_boards[b];
+   uint64_t stamp[CITIROC_NB_STAMPS];
+   memcpy(stamp, cycle->stamp, sizeof(stamp));
+   stamp[CITIROC_STAMP_DEQUEUE] = CITIROC_monotonicNs();
 
-    // TODO: Fix conversion to right int
-   uint32_t * words = (uint32_t*)gBuffer;
-   uint32_t* wordsHG = (uint32_t*)dataHG;
-   uint32_t* wordsLG = (uint32_t*)dataLG;
-
-   gettimeofday(&te,NULL);
-   long long etime = (long long)(te.tv_sec)*1000+(int)te.tv_usec/1000;
+   const int nbAcq      = cycle->nbWords / CITIROC_WORDS_PER_ACQ;
+   const int nbChannels = CITIROC_runGeometry.nbChannels;
+   const unsigned char* fifo[4] = {cycle->fifo[0].data(), cycle->fifo[1].data(),
+                                   cycle->fifo[2].data(), cycle->fifo[3].data()};
 
+   long long etime = cycle->timestamp;
    uint32_t etime1, etime2;
    etime1 = ((etime>>32)&0xFFFFFFFF);
    etime2 = ((etime)&0xFFFFFFFF);
-   //printf("%u %u\n",etime1,etime2);
-
 
    uint32_t *pddata;
-   uint32_t *pddataHG;
-   uint32_t *pddataLG;
-   uint32_t nEvtSze;
-   uint32_t sn = SERIAL_NUMBER(pevent);
-
-   // Create event header
-   bk_init32(pevent);
-
-   bk_create(pevent, BankName[0], TID_DWORD, (void**)&pddata);//cast to void (arturo 25/11/15)
-   bk_create(pevent, BankNameHG[0], TID_DWORD, (void**)&pddataHG);
-   bk_create(pevent, BankNameLG[0], TID_DWORD, (void**)&pddataLG);
+   uint16_t *pwdata;
 
-   //Add the time to the beginning
+   // Header: time (ms), cycle number, acquisitions, channels,
+   // configuration snapshot and live-reconfiguration latency (us)
+   bk_create(pevent, BankNameHeader[b], TID_DWORD, (void**)&pddata);
    *pddata++ = etime1;
    *pddata++ = etime2;
+   *pddata++ = cycle->cycleNumber;
+   *pddata++ = nbAcq;
+   *pddata++ = nbChannels;
+   *pddata++ = (uint32_t)cycle->configGeneration;
+   *pddata++ = (uint32_t)cycle->reconfigLatency;
+   bk_close(pevent, pddata);
+
+   uint16_t *bankHG, *bankLG;
+   uint32_t *bankHits;
+
+   // Compressed by the acquisition thread, unless zero suppression took over
+   const bool compressed = !config->zeroSuppression && !cycle->compressed.empty();
+
+   if (config->zeroSuppression || compressed) {
+     // Decoded aside for the spectra, pedestals and side channel;
+     // the bank gets only the channels with a hit or above their
+     // threshold, or the compressed FIFO bytes
+     static std::vector<uint16_t> sparseHG, sparseLG;
+     static std::vector<uint32_t> sparseHits;
+     sparseHG.resize(nbAcq * (nbChannels + 1));
+     sparseLG.resize(nbAcq * (nbChannels + 1));
+     sparseHits.resize(nbAcq);
+     bankHG   = sparseHG.data();
+     bankLG   = sparseLG.data();
+     bankHits = sparseHits.data();
+     CITIROC_decodeChannels(fifo[0], fifo[1], fifo[2], fifo[3], nbAcq, nbChannels, bankHG, bankLG);
+     CITIROC_decodeHits(fifo[0], nbAcq, nbChannels, bankHits);
+     if (config->pedestalTracking) CITIROC_pedestalsUpdate(&board.pedestalTable, bankHG, bankLG, bankHits, nbAcq, nbChannels);
+
+     if (compressed) {
+       // All 33 words of each acquisition, see CITIROC_decompressCycle
+       uint8_t *pbdata;
+       bk_create(pevent, BankNameCompressed[b], TID_BYTE, (void**)&pbdata);
+       memcpy(pbdata, cycle->compressed.data(), cycle->compressed.size());
+       bk_close(pevent, pbdata + cycle->compressed.size());
+     } else {
+       // Thresholds may follow the pedestals
+       int thresholds[CITIROC_NB_CHANNELS];
+       CITIROC_pedestalsThresholds(&board.pedestalTable, config->zeroSuppressionSigmas,
+                                   config->zeroSuppressionThresholds.data(), thresholds);
+       bk_create(pevent, BankNameSparse[b], TID_DWORD, (void**)&pddata);
+       pddata += CITIROC_encodeSparse(bankHG, bankLG, bankHits, nbAcq, nbChannels, thresholds, pddata);
+       bk_close(pevent, pddata);
+     }
+   } else if (config->pedestalSubtraction) {
+     // Spectra, pedestals and side channel keep the raw codes, decoded aside;
+     // the banks get signed pedestal-subtracted copies, corrected before bk_close
+     static std::vector<uint16_t> rawHG, rawLG;
+     static std::vector<uint32_t> rawHits;
+     const int nbWords = nbAcq * (nbChannels + 1);
+     rawHG.resize(nbWords);
+     rawLG.resize(nbWords);
+     rawHits.resize(nbAcq);
+     bankHG   = rawHG.data();
+     bankLG   = rawLG.data();
+     bankHits = rawHits.data();
+     CITIROC_decodeChannels(fifo[0], fifo[1], fifo[2], fifo[3], nbAcq, nbChannels, bankHG, bankLG);
+     CITIROC_decodeHits(fifo[0], nbAcq, nbChannels, bankHits);
+     if (config->pedestalTracking) CITIROC_pedestalsUpdate(&board.pedestalTable, bankHG, bankLG, bankHits, nbAcq, nbChannels);
+
+     bk_create(pevent, BankNameHG[b], TID_SHORT, (void**)&pwdata);
+     memcpy(pwdata, bankHG, nbWords * sizeof(uint16_t));
+     CITIROC_pedestalsSubtract(&board.pedestalTable, pwdata, NULL, nbAcq, nbChannels);
+     bk_close(pevent, pwdata + nbWords);
+
+     bk_create(pevent, BankNameLG[b], TID_SHORT, (void**)&pwdata);
+     memcpy(pwdata, bankLG, nbWords * sizeof(uint16_t));
+     CITIROC_pedestalsSubtract(&board.pedestalTable, NULL, pwdata, nbAcq, nbChannels);
+     bk_close(pevent, pwdata + nbWords);
+
+     // One hit mask per acquisition, bit n for channel n
+     bk_create(pevent, BankNameHits[b], TID_DWORD, (void**)&pddata);
+     memcpy(pddata, bankHits, nbAcq * sizeof(uint32_t));
+     bk_close(pevent, pddata + nbAcq);
+   } else {
+     // ADC values decoded straight into the bank memory,
+     // nbChannels channels + temperature sensor per acquisition
+     bk_create(pevent, BankNameHG[b], TID_WORD, (void**)&bankHG);
+     pwdata = bankHG + CITIROC_decodeChannels(fifo[0], fifo[1], fifo[2], fifo[3], nbAcq, nbChannels, bankHG, NULL);
+     bk_close(pevent, pwdata);
+
+     bk_create(pevent, BankNameLG[b], TID_WORD, (void**)&bankLG);
+     pwdata = bankLG + CITIROC_decodeChannels(fifo[0], fifo[1], fifo[2], fifo[3], nbAcq, nbChannels, NULL, bankLG);
+     bk_close(pevent, pwdata);
+
+     // One hit mask per acquisition, bit n for channel n
+     bk_create(pevent, BankNameHits[b], TID_DWORD, (void**)&bankHits);
+     pddata = bankHits + CITIROC_decodeHits(fifo[0], nbAcq, nbChannels, bankHits);
+     bk_close(pevent, pddata);
+     if (config->pedestalTracking) CITIROC_pedestalsUpdate(&board.pedestalTable, bankHG, bankLG, bankHits, nbAcq, nbChannels);
+   }
 
-   // copy data into event
-   int i;
-   int buffsize_32 = buffsize/4; // Calculate number of 32-bit words
-   for(i = 0; i < buffsize_32; i++){
-     *pddata++ = words[i];
-     *pddataHG++ = atoi(wordsHG[i]);
-     *pddataLG++ = atoi(wordsLG[i]);
-     //printf("  data[%i] = 0x%x\n",i,words[i]);
+   stamp[CITIROC_STAMP_DECODED] = CITIROC_monotonicNs();
+
+   // Spectra and hit counters, from the values just decoded
+   if (config->histograms) {
+     CITIROC_histogramsFill(&board.spectra, bankHG, bankLG, bankHits, nbAcq, nbChannels);
    }
 
-   bk_close(pevent, pddata);	
+   // Scan summary on the last cycle of each point: point, ASIC field, value index
+   // (-1 for all), value, acquisitions, then hits of each channel
+   if (cycle->scanPointDone) {
+     const CITIROC_scanPoint& point = cycle->scanPoint;
+     bk_create(pevent, BankNameScan[b], TID_DWORD, (void**)&pddata);
+     *pddata++ = point.index;
+     *pddata++ = board.acq.scan.field;
+     *pddata++ = board.acq.scan.channel;
+     *pddata++ = point.value;
+     *pddata++ = point.nbAcq;
+     for (int chn=0; chn<nbChannels; chn++) *pddata++ = point.hits[chn];
+     bk_close(pevent, pddata);
+   }
+
+   // Side-channel copy; dropped rather than waited for if the writer lags
+   CITIROC_pushCycle(&board.sideWriter, cycle->cycleNumber, cycle->timestamp,
+                     nbAcq, nbChannels, bankHG, bankLG, bankHits);
+
+   // Readout stages, from the end of the last FIFO read
+   stamp[CITIROC_STAMP_BANKED] = CITIROC_monotonicNs();
+   CITIROC_latenciesRecord(&board.acq.latency, stamp, CITIROC_STAMP_FIFO24, CITIROC_STAMP_BANKED);
+}
+
+INT read_trigger_event(char *pevent, INT off)
+{
+   // Event built by poll_event
+   if (!CITIROC_eventReady) return 0;
+   const CITIROC_builtEvent& event = CITIROC_nextEvent;
+
+   // Create event header
+   bk_init32(pevent);
+
+   // Builder header: key (upper and lower 32 bits), mask of the boards present,
+   // 1 if the fragment is late for an event already built
+   uint32_t *pddata;
+   bk_create(pevent, BankNameBuilder, TID_DWORD, (void**)&pddata);
+   *pddata++ = (uint32_t)((event.key>>32)&0xFFFFFFFF);
+   *pddata++ = (uint32_t)((event.key)&0xFFFFFFFF);
+   *pddata++ = event.mask;
+   *pddata++ = event.late;
+   bk_close(pevent, pddata);
+
+   // Banks of each board present
+   std::shared_ptr<const CITIROC_config> config = CITIROC_getConfig();
+   for (int b=0; b<CITIROC_nbBoards; b++) {
+     if (event.fragment[b] != NULL) write_board_banks(pevent, b, event.fragment[b], config);
+   }
+
+   // Hand the slots back to the acquisition threads
+   CITIROC_builderRelease(&CITIROC_eventBuilder, &event);
+   CITIROC_eventReady = false;
 
    //primitive progress bar
    //if (sn % 100 == 0) printf(".%d",bk_size(pevent));
@@ -860,21 +1312,180 @@ INT read_slow_event(char *pevent, INT off)
    //Add the time to the beginning
    *pddata++ = etime1;
    *pddata++ = etime2;
-
-   // Get number of stored events
-   uint32_t Data;
-   CAEN_DGTZ_ReadRegister(handle,0x812c,&Data);
-   *pddata++ = Data;
-
    bk_close(pevent, pddata);	
-   
-   // Send a software trigger
-   if(tsvc[0].sw_trigger){
-     int ret = CAEN_DGTZ_SendSWtrigger(handle);
-     //printf("SW Trigger returns %i\n",ret);
+
+   // Event building: events, complete events, orphan fragments,
+   // late fragments, events built after the timeout
+   bk_create(pevent, BankNameBuilderStats, TID_DWORD, (void**)&pddata);
+   *pddata++ = (uint32_t)CITIROC_eventBuilder.events;
+   *pddata++ = (uint32_t)CITIROC_eventBuilder.complete;
+   *pddata++ = (uint32_t)CITIROC_eventBuilder.orphans;
+   *pddata++ = (uint32_t)CITIROC_eventBuilder.late;
+   *pddata++ = (uint32_t)CITIROC_eventBuilder.timeouts;
+   bk_close(pevent, pddata);
+
+   static time_t lastAudit = 0;
+   const int auditPeriod = CITIROC_getConfig()->auditPeriod;
+   const bool audit = auditPeriod > 0 && te.tv_sec - lastAudit >= auditPeriod;
+   if (audit) lastAudit = te.tv_sec;
+
+   for (int b=0; b<CITIROC_nbBoards; b++) {
+     CITIROC_board& board = CITIROC_boards[b];
+
+     // Shadow copy of the FPGA registers, free of USB traffic
+     uint8_t *pbdata;
+     bk_create(pevent, BankNameRegisters[b], TID_BYTE, (void**)&pbdata);
+     for (int sub=0; sub<CITIROC_NB_SUBADDRESSES; sub++) {
+       byte value = 0;
+       CITIROC_shadowGet(&CITIROC_getBoardState(board.usbID).shadow, sub, &value);
+       *pbdata++ = value;
+     }
+     bk_close(pevent, pbdata);
+
+     // Pedestal table: samples, HG mean, HG sigma, LG mean, LG sigma of each channel
+     float *pfdata;
+     if (board.pedestalTable.nbChannels > 0) {
+       bk_create(pevent, BankNamePedestals[b], TID_FLOAT, (void**)&pfdata);
+       for (int chn=0; chn<board.pedestalTable.nbChannels; chn++) {
+         *pfdata++ = (float)board.pedestalTable.hg[chn].n;
+         *pfdata++ = (float)board.pedestalTable.hg[chn].mean;
+         *pfdata++ = (float)CITIROC_pedestalSigma(board.pedestalTable.hg[chn]);
+         *pfdata++ = (float)board.pedestalTable.lg[chn].mean;
+         *pfdata++ = (float)CITIROC_pedestalSigma(board.pedestalTable.lg[chn]);
+       }
+       bk_close(pevent, pfdata);
+     }
+
+     // Throughput of the board since the previous slow event: cycles/s, acquisitions/s,
+     // bytes/s of FIFOs 20, 21, 23 and 24, mean and p99 cycle latency (us),
+     // status polls per cycle, expected fill time of a cycle (us),
+     // live fraction, live and dead time of the run (s), cycles dropped at stop or pause
+     CITIROC_statistics& statistics = board.statistics;
+     CITIROC_statisticsUpdate(&statistics, &board.acq);
+     bk_create(pevent, BankNameStatistics[b], TID_FLOAT, (void**)&pfdata);
+     *pfdata++ = (float)statistics.cycleRate;
+     *pfdata++ = (float)statistics.acquisitionRate;
+     for (int k=0; k<4; k++) *pfdata++ = (float)statistics.byteRate[k];
+     *pfdata++ = (float)statistics.meanLatency;
+     *pfdata++ = (float)statistics.p99Latency;
+     *pfdata++ = (float)statistics.pollsPerCycle;
+     *pfdata++ = (float)statistics.fillTime;
+     *pfdata++ = (float)statistics.liveFraction;
+     *pfdata++ = (float)statistics.liveTime;
+     *pfdata++ = (float)statistics.deadTime;
+     *pfdata++ = (float)statistics.droppedCycles;
+     bk_close(pevent, pfdata);
+
+     // Counters of the run: cycles, acquisitions, restarts, timeouts,
+     // short reads, full ring, USB errors since the board was opened, status polls,
+     // arming batches cut short by a USB transfer
+     bk_create(pevent, BankNameCounters[b], TID_DWORD, (void**)&pddata);
+     *pddata++ = (uint32_t)statistics.cycles;
+     *pddata++ = (uint32_t)statistics.acquisitions;
+     *pddata++ = statistics.restarts;
+     *pddata++ = statistics.timeouts;
+     *pddata++ = statistics.shortReads;
+     *pddata++ = statistics.ringFull;
+     *pddata++ = statistics.usbErrors;
+     *pddata++ = (uint32_t)statistics.statusPolls;
+     *pddata++ = statistics.armErrors;
+     bk_close(pevent, pddata);
+
+     // Same values at ODB, for the status pages
+     if (board.statisticsOdb != NULL) {
+       midas::odb& odb = *board.statisticsOdb;
+       odb["Cycles/s"]        = statistics.cycleRate;
+       odb["Acquisitions/s"]  = statistics.acquisitionRate;
+       odb["FIFO 20 bytes/s"] = statistics.byteRate[0];
+       odb["FIFO 21 bytes/s"] = statistics.byteRate[1];
+       odb["FIFO 23 bytes/s"] = statistics.byteRate[2];
+       odb["FIFO 24 bytes/s"] = statistics.byteRate[3];
+       odb["Mean cycle latency (us)"] = statistics.meanLatency;
+       odb["P99 cycle latency (us)"]  = statistics.p99Latency;
+       odb["Status polls/cycle"]      = statistics.pollsPerCycle;
+       odb["Expected fill time (us)"] = statistics.fillTime;
+       odb["Live fraction"]   = statistics.liveFraction;
+       odb["Live time (s)"]   = statistics.liveTime;
+       odb["Dead time (s)"]   = statistics.deadTime;
+       odb["Cycles"]          = (int)statistics.cycles;
+       odb["Acquisitions"]    = (int)statistics.acquisitions;
+       odb["Restarts (subaddress 22)"] = (int)statistics.restarts;
+       odb["Timeouts"]        = (int)statistics.timeouts;
+       odb["Short reads"]     = (int)statistics.shortReads;
+       odb["Full ring"]       = (int)statistics.ringFull;
+       odb["USB errors"]      = (int)statistics.usbErrors;
+       odb["Status polls"]    = (int)statistics.statusPolls;
+       odb["Arming USB errors"] = (int)statistics.armErrors;
+       odb["Dropped cycles"]  = (int)statistics.droppedCycles;
+     }
+
+     // Latency of each readout stage, see CITIROC_latency.h: entries,
+     // mean, median, 99th percentile and maximum (us)
+     bk_create(pevent, BankNameLatency[b], TID_FLOAT, (void**)&pfdata);
+     for (int stage=0; stage<CITIROC_NB_LATENCIES; stage++) {
+       const CITIROC_latencyHistogram& histogram = board.acq.latency.stage[stage];
+       const uint64_t count = histogram.count.load();
+       *pfdata++ = (float)count;
+       *pfdata++ = (count > 0) ? (float)(1e-3 * histogram.sum.load() / count) : 0.f;
+       *pfdata++ = (float)(1e-3 * CITIROC_latencyPercentile(histogram, 0.50));
+       *pfdata++ = (float)(1e-3 * CITIROC_latencyPercentile(histogram, 0.99));
+       *pfdata++ = (float)(1e-3 * histogram.max.load());
+     }
+     bk_close(pevent, pfdata);
+
+     // Compare shadow and board now and then, only while the
+     // acquisition thread leaves the USB link alone.
+     if (audit && !board.acq.running) {
+       int nbDiffs = CITIROC_auditRegisters(board.usbID);
+       if (nbDiffs != 0) cm_msg(MERROR, "read_slow_event", "Register audit: %d FPGA registers of board %s differ from the values written.",
+                                nbDiffs, board.serialNumber.c_str());
+     }
    }
 
    return bk_size(pevent);
 
 }
  
+
+/*-- Histogram readout ---------------------------------------------*/
+
+INT read_histogram_event(char *pevent, INT off)
+{
+   // Spectra accumulated since the start of the run, one bin per ADC code
+   if (!CITIROC_getConfig()->histograms) return 0;
+
+   uint32_t *pddata;
+   bk_init32(pevent);
+
+   // As many boards as fit in an event, taking turns
+   static int nextBoard = 0;
+   int nbPublished = 0;
+   for (int k=0; k<CITIROC_nbBoards; k++) {
+     const int b = (nextBoard + k) % CITIROC_nbBoards;
+     const CITIROC_histograms& spectra = CITIROC_boards[b].spectra;
+     if (spectra.nbAcq == 0) continue;
+     const int nbBins = spectra.nbChannels * CITIROC_HISTOGRAM_BINS;
+     const int nbBytes = (2*nbBins + 1 + spectra.nbChannels) * sizeof(uint32_t) + 3 * sizeof(BANK32);
+     if (nbPublished > 0 && bk_size(pevent) + nbBytes > max_event_size) {nextBoard = b; break;}
+
+     // HG and LG spectra: channel n in bins n*4096 to n*4096+4095
+     bk_create(pevent, BankNameSpectraHG[b], TID_DWORD, (void**)&pddata);
+     memcpy(pddata, spectra.hg.data(), nbBins*sizeof(uint32_t));
+     bk_close(pevent, pddata + nbBins);
+
+     bk_create(pevent, BankNameSpectraLG[b], TID_DWORD, (void**)&pddata);
+     memcpy(pddata, spectra.lg.data(), nbBins*sizeof(uint32_t));
+     bk_close(pevent, pddata + nbBins);
+
+     // Acquisitions, then hits of each channel
+     bk_create(pevent, BankNameHitCounts[b], TID_DWORD, (void**)&pddata);
+     *pddata++ = spectra.nbAcq;
+     for (int chn=0; chn<spectra.nbChannels; chn++) *pddata++ = spectra.hits[chn];
+     bk_close(pevent, pddata);
+     nbPublished++;
+     nextBoard = (b + 1) % CITIROC_nbBoards;
+   }
+   if (nbPublished == 0) return 0;
+
+   return bk_size(pevent);
+}